@@ -0,0 +1,7 @@
+# example sweep spec for the sweep tool
+# 2 x 2 x 2 = 8 configurations around the default geometry
+
+base default
+index_length 9 10
+component_count 6..7
+max_history 130 200
@@ -0,0 +1,106 @@
+// bimodal.h
+// This file declares a plain bimodal predictor: a table of 2-bit counters
+// indexed by the low bits of the branch address.  It is the cheapest
+// predictor we model and a baseline for the others.  bimodal_table is the
+// counters alone, as a component of an ensemble (see ensemble.h).
+
+#ifndef BIMODAL_H
+#define BIMODAL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "branch.h"
+#include "predictor.h"
+#include "storage.h"
+
+class bimodal_table {
+public:
+	static const uint32_t INDEX_LENGTH = 14;
+	static const uint32_t SIZE = 1 << INDEX_LENGTH;
+
+	bimodal_table(void) {
+		memset(counters, 2, sizeof counters);
+	}
+
+	bool predict(uint32_t pc) {
+		return counters[index(pc)] >> 1;
+	}
+
+	void update(uint32_t pc, bool taken) {
+		uint8_t &c = counters[index(pc)];
+		if (taken && c < 0b11) {
+			c++;
+		} else if (!taken && c > 0b00) {
+			c--;
+		}
+	}
+
+	void storage(storage_report &r) const {
+		r.add("bimodal", 2 * SIZE);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(counters);
+	}
+
+private:
+	uint8_t counters[SIZE]; // 2 bit counters
+
+	static uint32_t index(uint32_t pc) {
+		return pc & (SIZE - 1);
+	}
+};
+
+class bimodal_predictor {
+public:
+	typedef branch_update update_type;
+
+	void predict(const branch_info &b, update_type &u) {
+		if (b.br_flags & BR_CONDITIONAL) {
+			u.direction_prediction(table.predict(b.address));
+			u.provider(0);
+		} else {
+			u.direction_prediction(true);
+		}
+		u.target_prediction(0);
+	}
+
+	void update(const branch_info &b, update_type &, bool taken, unsigned int) {
+		if (b.br_flags & BR_CONDITIONAL) {
+			table.update(b.address, taken);
+		}
+	}
+
+	// the delayed update (see simulate.h); with no history there is
+	// nothing to speculate, resolve or checkpoint
+
+	void speculate(const branch_info &, update_type &) {
+	}
+
+	void resolve(const branch_info &, update_type &, bool, unsigned int) {
+	}
+
+	void retire(const branch_info &b, update_type &u, bool taken, unsigned int target) {
+		update(b, u, taken, target);
+	}
+
+	int checkpoint_bits() const {
+		return 0;
+	}
+
+	void storage(storage_report &r) const {
+		table.storage(r);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		table.serialize(io);
+	}
+
+private:
+	bimodal_table table;
+};
+
+#endif // BIMODAL_H
@@ -0,0 +1,134 @@
+#!/bin/sh
+# check.sh
+# This file is the regression check behind "make check".  It makes small
+# synthetic traces with tracegen, runs predict, chunked and ct over them,
+# and compares everything they print with check.expected, so a change
+# that moves any predictor's mispredictions shows up as a diff.  Besides
+# the recorded output it checks the round trips that should lose nothing:
+#	- a run cut in two at a checkpoint (-S, then -L) ends in the same
+#	  state as the run in one piece
+#	- ct's containers, entropy-coded and zlib, decompress to the trace,
+#	  and predict and chunked read them as they read the trace itself;
+#	  predict and mkindex read them the same from standard input.  one
+#	  entropy-coded container has small blocks, so chunked starts its
+#	  chunks inside blocks
+#	- a -n run gives the same figures whether the trace's length comes
+#	  from its index (-I) or from reading the rest of the trace
+#
+# Usage: check.sh [-u]
+#	-u	record the output as the new check.expected instead of
+#		comparing; do this only after checking that the changes
+#		in the diff are meant
+
+src=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' 0
+cd "$work" || exit 1
+
+failed=0
+
+# run one of the tools, printing the command line and all its output
+
+run () {
+	tool=$1
+	shift
+	echo "== $tool $*"
+	"$src/$tool" "$@" 2>&1
+}
+
+# say whether two files are the same
+
+same () {
+	if cmp -s "$2" "$3"; then
+		echo "$1: same"
+	else
+		echo "$1: DIFFERENT"
+		failed=1
+	fi
+}
+
+(
+	for w in loops calls correlated; do
+		"$src/tracegen" -n 200000 -o $w.trace "$src/../workloads/$w.wl" || exit 1
+	done
+
+	# each predictor and geometry, with the interval records for finer
+	# figures than the final MPKI
+
+	for w in loops calls correlated; do
+		run predict -i 50000 $w.trace
+	done
+	for p in bimodal perceptron tournament alpha ensemble; do
+		run predict -p $p calls.trace
+	done
+	for g in small large default-scl default-local; do
+		run predict -g $g correlated.trace
+	done
+	cp "$src/../geometries/example.cfg" .
+	run predict -f example.cfg correlated.trace
+	run predict -V correlated.trace
+	run predict -V -p perceptron calls.trace
+	run predict -d 8 correlated.trace
+	run predict -p bimodal -d 8 calls.trace
+	run predict -w 50000 -P 5 calls.trace
+
+	# partial runs charge their share of the whole trace's instructions
+
+	run mkindex -n 50000 correlated.trace correlated.idx
+	run predict -n 50000 correlated.trace > n.out
+	run predict -n 50000 -I correlated.idx correlated.trace > ni.out
+	cat n.out
+	sed 1d ni.out > ni.body
+	sed 1d n.out > n.body
+	same "-n with and without -I" n.body ni.body
+	run predict -k 100000 -n 50000 correlated.trace
+
+	# a run in two pieces through a checkpoint
+
+	run predict -S whole.ck correlated.trace
+	run predict -n 120000 -S first.ck correlated.trace
+	run predict -L first.ck -S second.ck correlated.trace
+	same "checkpoint round-trip" whole.ck second.ck
+
+	# both kinds of container
+
+	"$src/compress/ct" -c correlated.trace > coded.cbpz 2> /dev/null
+	"$src/compress/ct" -z -c correlated.trace > zlib.cbpz 2> /dev/null
+	"$src/compress/ct" -b 16384 -c correlated.trace > blocks.cbpz 2> /dev/null
+	"$src/predict" correlated.trace > trace.out 2>&1
+	"$src/chunked" -j 2 -c 50000 -w 50000 correlated.trace correlated.idx > trace.chunked 2>&1
+	cat trace.chunked
+	for c in coded zlib blocks; do
+		"$src/compress/ct" -d $c.cbpz 2> /dev/null > $c.trace
+		same "$c container round-trip" correlated.trace $c.trace
+		"$src/predict" $c.cbpz > $c.out 2>&1
+		same "predict on the $c container" trace.out $c.out
+		"$src/predict" - < $c.cbpz > $c.stdin 2>&1
+		same "predict on the $c container from stdin" trace.out $c.stdin
+		"$src/mkindex" -n 50000 $c.cbpz $c.idx > /dev/null 2>&1
+		"$src/mkindex" -n 50000 - $c.stdin.idx < $c.cbpz > /dev/null 2>&1
+		same "mkindex on the $c container from stdin" $c.idx $c.stdin.idx
+		"$src/chunked" -j 2 -c 50000 -w 50000 $c.cbpz $c.idx > $c.chunked 2>&1
+		same "chunked on the $c container" trace.chunked $c.chunked
+	done
+
+	# an index counts offsets in the pre-processed stream, which both
+	# containers hold
+
+	same "mkindex on both containers" coded.idx zlib.idx
+	exit $failed
+) > check.out
+status=$?
+
+if [ "$1" = "-u" ]; then
+	cp check.out "$src/check.expected"
+	echo "recorded $src/check.expected"
+elif ! diff -u "$src/check.expected" check.out; then
+	echo "check: the output differs from check.expected"
+	exit 1
+fi
+if [ $status -ne 0 ]; then
+	echo "check: a round trip failed"
+	exit 1
+fi
+echo "check: all passed"
@@ -0,0 +1,74 @@
+// checkpoint.cc
+// This file contains the checkpoint file format:
+//	"BCKP"			magic
+//	uint32_t version	2 (1 had TAGE and the perceptron keep their own
+//				global histories)
+//	uint32_t length		of the identity
+//	char identity[length]	the predictor and its configuration
+//	uint64_t position	branches of the trace seen
+//	uint64_t size		bytes of state
+// and then the state itself, as the predictor's serialize () lays it out.
+// All integers are little-endian.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+using namespace std;
+
+#include "checkpoint.h"
+
+#define CHECKPOINT_VERSION	2
+
+bool write_checkpoint (const char *fname, const char *identity, uint64_t position, simulator *p) {
+	uint64_t size = p->state_size ();
+	if (size == 0) {
+		fprintf (stderr, "%s: this predictor cannot be checkpointed\n", fname);
+		return false;
+	}
+	FILE *f = fopen (fname, "wb");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+	uint32_t header[2] = { CHECKPOINT_VERSION, (uint32_t) strlen (identity) };
+	fwrite ("BCKP", 1, 4, f);
+	fwrite (header, sizeof header, 1, f);
+	fwrite (identity, 1, header[1], f);
+	fwrite (&position, sizeof position, 1, f);
+	fwrite (&size, sizeof size, 1, f);
+	bool ok = p->save_state (f) && !ferror (f);
+	if (fclose (f) != 0) ok = false;
+	if (!ok) perror (fname);
+	return ok;
+}
+
+bool read_checkpoint (const char *fname, const char *identity, uint64_t &position, simulator *p) {
+	FILE *f = fopen (fname, "rb");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+	const char *problem = NULL;
+	char magic[4];
+	uint32_t header[2];
+	uint64_t size;
+	string id;
+	if (fread (magic, sizeof magic, 1, f) != 1 || memcmp (magic, "BCKP", 4) != 0
+	 || fread (header, sizeof header, 1, f) != 1) {
+		problem = "not a checkpoint";
+	} else if (header[0] != CHECKPOINT_VERSION) {
+		problem = "unknown checkpoint version";
+	} else {
+		id.resize (header[1]);
+		if (header[1] && fread (&id[0], header[1], 1, f) != 1) problem = "truncated checkpoint";
+		else if (id != identity) problem = "checkpoint of a different predictor or configuration";
+		else if (fread (&position, sizeof position, 1, f) != 1
+		      || fread (&size, sizeof size, 1, f) != 1) problem = "truncated checkpoint";
+		else if (size != p->state_size ()) problem = "checkpoint state is the wrong size";
+		else if (!p->load_state (f)) problem = "truncated checkpoint";
+	}
+	fclose (f);
+	if (problem) fprintf (stderr, "%s: %s\n", fname, problem);
+	return !problem;
+}
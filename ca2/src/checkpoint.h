@@ -0,0 +1,25 @@
+// checkpoint.h
+// This file declares predictor checkpoints: a predictor's whole state in a
+// file, with where in the trace it was taken.  Loading one into a freshly
+// built predictor of the same kind and resuming the trace at that position
+// continues the run exactly where the checkpoint left it.
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "simulate.h"
+
+// write p's state to fname.  identity names the predictor and its
+// configuration; position is the number of the trace's branches p has seen.
+// returns false, after saying why, on error.
+
+bool write_checkpoint (const char *fname, const char *identity, uint64_t position, simulator *p);
+
+// read a checkpoint written by the same identity into p, and return its
+// position.  returns false, after saying why, if that fails.
+
+bool read_checkpoint (const char *fname, const char *identity, uint64_t &position, simulator *p);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,208 @@
+// chunked.cc
+// This file contains the chunked simulator.  It cuts one trace into chunks
+// and simulates them on all cores at once, each from a fresh predictor.
+// Each chunk starts decoding from a snapshot in the trace's index (see
+// mkindex.cc), so no chunk waits for the ones before it.  A fresh
+// predictor knows nothing, so each chunk first trains on the traces just
+// before it, without counting them.  The result is an approximation of
+// the sequential MPKI, and with -e the sequential run is done as well and
+// the error reported.
+//
+// Usage: chunked [-p predictor] [-g geometry] [-f config] [-s seed]
+//		  [-j threads] [-c chunk] [-w warmup] [-e] trace index
+//	-p, -g, -f, -s	as for predict
+//	-j threads	worker threads (default: one per core)
+//	-c chunk	traces per chunk (default: the trace split evenly
+//			over the threads)
+//	-w warmup	traces to train on before each chunk (default: the
+//			index interval)
+//	-e		also run the whole trace sequentially and report
+//			the error of the chunked figure
+// Chunk and warmup lengths are rounded up to multiples of the index
+// interval, since decoding can only start at a snapshot.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+#include "simulate.h"
+#include "tage_geometry.h"
+#include "registry.h"
+
+#define BATCH_SIZE	4096
+
+// one piece of work: count traces [start, end), training first on
+// [warm, start).  the sequential run is the job with warm = start = 0 and
+// end the whole trace.
+
+struct job {
+	uint64_t warm, start, end;
+	sim_stats stats;
+	bool ok;
+};
+
+static const char *trace_name, *index_name, *predictor_name = "tage";
+static tage_geometry geometry;
+static uint32_t seed = DEFAULT_SEED;
+static vector<job> jobs;
+static atomic<size_t> next_job (0);
+
+// simulate traces from r until n have gone by or the trace ends
+
+static uint64_t simulate (trace_reader &r, simulator *p, uint64_t n, sim_stats &s) {
+	vector<trace> batch (BATCH_SIZE);
+	uint64_t done = 0;
+	while (done < n) {
+		size_t k = r.read (&batch[0], min ((uint64_t) BATCH_SIZE, n - done));
+		if (k == 0) break;
+		p->run (&batch[0], k, s);
+		done += k;
+	}
+	return done;
+}
+
+static void run_job (job &j) {
+	trace_reader r;
+	simulator *p = make_simulator (predictor_name, geometry, seed);
+	j.ok = r.open (trace_name) && r.seek (index_name, j.warm);
+	if (j.ok) {
+		sim_stats warmup;
+		j.ok = simulate (r, p, j.start - j.warm, warmup) == j.start - j.warm
+		    && simulate (r, p, j.end - j.start, j.stats) == j.end - j.start;
+		if (!j.ok) fprintf (stderr, "%s: ended early\n", trace_name);
+		r.close ();
+	}
+	delete p;
+}
+
+static void worker (void) {
+	for (;;) {
+		size_t i = next_job++;
+		if (i >= jobs.size ()) return;
+		run_job (jobs[i]);
+	}
+}
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-p predictor] [-g geometry] [-f config] [-s seed] [-j threads] [-c chunk] [-w warmup] [-e] trace index\n", prog);
+	exit (1);
+}
+
+static uint64_t round_up (uint64_t x, uint64_t m) {
+	return (x + m - 1) / m * m;
+}
+
+int main (int argc, char *argv[]) {
+	int nthreads = thread::hardware_concurrency ();
+	long long int chunk = 0, warmup = -1;
+	bool sequential = false;
+	int c;
+
+	while ((c = getopt (argc, argv, "p:g:f:s:j:c:w:e")) != -1) {
+		switch (c) {
+		case 'p':
+			predictor_name = optarg;
+			break;
+		case 'g':
+			if (!lookup_geometry (optarg, geometry)) {
+				fprintf (stderr, "%s: no geometry called \"%s\"\n", argv[0], optarg);
+				exit (1);
+			}
+			break;
+		case 'f':
+			if (!read_geometry_file (geometry, optarg)) exit (1);
+			break;
+		case 's':
+			seed = strtoul (optarg, NULL, 0);
+			break;
+		case 'j':
+			nthreads = atoi (optarg);
+			break;
+		case 'c':
+			chunk = atoll (optarg);
+			if (chunk <= 0) usage (argv[0]);
+			break;
+		case 'w':
+			warmup = atoll (optarg);
+			if (warmup < 0) usage (argv[0]);
+			break;
+		case 'e':
+			sequential = true;
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+	if (argc - optind != 2) usage (argv[0]);
+	if (nthreads < 1) nthreads = 1;
+	trace_name = argv[optind];
+	index_name = argv[optind + 1];
+	const char *problem = check_geometry (geometry);
+	if (problem) {
+		fprintf (stderr, "%s: bad geometry: %s\n", argv[0], problem);
+		exit (1);
+	}
+	simulator *probe = make_simulator (predictor_name, geometry, seed);
+	if (!probe) {
+		fprintf (stderr, "%s: no predictor called \"%s\"\n", argv[0], predictor_name);
+		exit (1);
+	}
+	delete probe;
+
+	uint32_t interval;
+	uint64_t traces;
+	if (!index_info (index_name, interval, traces)) exit (1);
+	if (chunk == 0) chunk = (traces + nthreads - 1) / nthreads;
+	chunk = round_up (chunk, interval);
+	if (warmup < 0) warmup = interval;
+	warmup = round_up (warmup, interval);
+
+	// the sequential run, if any, goes first since it takes longest
+
+	if (sequential) {
+		job j = { 0, 0, traces, sim_stats (), false };
+		jobs.push_back (j);
+	}
+	for (uint64_t start = 0; start < traces; start += chunk) {
+		job j = { start > (uint64_t) warmup ? start - warmup : 0, start,
+			min (start + (uint64_t) chunk, traces), sim_stats (), false };
+		jobs.push_back (j);
+	}
+
+	vector<thread> workers;
+	for (int i = 0; i < nthreads; i++) workers.push_back (thread (worker));
+	for (int i = 0; i < nthreads; i++) workers[i].join ();
+
+	// add up the chunks.  each trace represents exactly 100 million
+	// instructions.
+
+	long long int dmiss = 0, tmiss = 0;
+	for (size_t i = sequential; i < jobs.size (); i++) {
+		const job &j = jobs[i];
+		if (!j.ok) exit (1);
+		printf ("chunk %llu..%llu, warmup from %llu: %lld mispredictions\n",
+			(unsigned long long) j.start, (unsigned long long) j.end,
+			(unsigned long long) j.warm, j.stats.dmiss);
+		dmiss += j.stats.dmiss;
+		tmiss += j.stats.tmiss;
+	}
+	double mpki = 1000.0 * (dmiss / 1e8);
+	if (sequential) {
+		if (!jobs[0].ok) exit (1);
+		double exact = 1000.0 * (jobs[0].stats.dmiss / 1e8);
+		printf ("%0.3f sequential MPKI, error %+0.3f MPKI (%+0.2f%%)\n",
+			exact, mpki - exact, exact ? 100.0 * (mpki - exact) / exact : 0.0);
+	}
+	printf ("%0.3f target MPKI\n", 1000.0 * (tmiss / 1e8));
+	printf ("%0.3f MPKI\n", mpki);
+	exit (0);
+}
@@ -0,0 +1,225 @@
+// container.cc
+// This file contains the container writer, with its pool of compression
+// threads, and reader.  Each thread has its own trace_coder for version 2
+// blocks.  The thread that produces the stream also writes
+// the blocks out, in order, as the workers finish them; it stalls only
+// when max_pending blocks are waiting.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "container.h"
+
+using namespace std;
+
+container_writer::container_writer (FILE *out, int threads, int version, int level, uint32_t block_size)
+	: out (out), version (version), level (level), block_size (block_size), ok (true),
+	  max_pending (2 * threads), stopping (false) {
+	fill = new block;
+	if (threads <= 0) return;
+	uint32_t header[2] = { (uint32_t) version, block_size };
+	fwrite (CONTAINER_MAGIC, 1, 4, out);
+	fwrite (header, sizeof header, 1, out);
+	for (int i = 0; i < threads; i++) workers.push_back (thread (&container_writer::worker, this));
+}
+
+container_writer::~container_writer (void) {
+	delete fill;
+	for (size_t i = 0; i < spare.size (); i++) delete spare[i];
+}
+
+void container_writer::compress (block *b, trace_coder *coder) {
+	if (version == CONTAINER_CODED) {
+
+		// the units of a well-formed stream are its traces
+
+		b->packed.clear ();
+		range_encoder e (b->packed);
+		coder->reset ();
+		size_t pos = 0, i = 0;
+		while (pos < b->raw.size ()) {
+			int n = trace_coder::unit_length (&b->raw[pos], b->raw.size () - pos);
+			if (n == 0 || i == b->contexts.size ()) {
+				fprintf (stderr, "the stream does not split into traces\n");
+				exit (1);
+			}
+			coder->unit (e, b->contexts[i++], &b->raw[pos]);
+			pos += n;
+		}
+		e.flush ();
+		return;
+	}
+	uLongf n = compressBound (b->raw.size ());
+	b->packed.resize (n);
+	if (compress2 (&b->packed[0], &n, &b->raw[0], b->raw.size (), level) != Z_OK) {
+		fprintf (stderr, "zlib failed to compress a block\n");
+		exit (1);
+	}
+	b->packed.resize (n);
+}
+
+void container_writer::worker (void) {
+	trace_coder *coder = version == CONTAINER_CODED ? new trace_coder : NULL;
+	for (;;) {
+		block *b;
+		{
+			unique_lock<mutex> l (m);
+			while (queue.empty () && !stopping) work_ready.wait (l);
+			if (queue.empty ()) break;
+			b = queue.front ();
+			queue.pop_front ();
+		}
+		compress (b, coder);
+		lock_guard<mutex> l (m);
+		b->done = true;
+		work_done.notify_all ();
+	}
+	delete coder;
+}
+
+void container_writer::write_block (block *b) {
+	uint32_t header[2] = { (uint32_t) b->raw.size (), (uint32_t) b->packed.size () };
+	if (fwrite (header, sizeof header, 1, out) != 1
+	 || fwrite (&b->packed[0], b->packed.size (), 1, out) != 1) ok = false;
+	b->raw.clear ();
+	b->contexts.clear ();
+	spare.push_back (b);
+}
+
+void container_writer::submit (void) {
+
+	// plain output goes straight through
+
+	if (workers.empty ()) {
+		if (fwrite (&fill->raw[0], fill->raw.size (), 1, out) != 1) ok = false;
+		fill->raw.clear ();
+		return;
+	}
+
+	unique_lock<mutex> l (m);
+	fill->done = false;
+	pending.push_back (fill);
+	queue.push_back (fill);
+	work_ready.notify_one ();
+
+	// write whatever is finished at the front, and wait for the front
+	// if too much is pending
+
+	while (!pending.empty () && (pending.front ()->done || pending.size () >= max_pending)) {
+		while (!pending.front ()->done) work_done.wait (l);
+		write_block (pending.front ());
+		pending.pop_front ();
+	}
+	if (spare.empty ()) {
+		fill = new block;
+	} else {
+		fill = spare.back ();
+		spare.pop_back ();
+	}
+	fill->raw.reserve (block_size);
+}
+
+bool container_writer::finish (void) {
+	if (!fill->raw.empty ()) submit ();
+	if (!workers.empty ()) {
+		{
+			unique_lock<mutex> l (m);
+			while (!pending.empty ()) {
+				while (!pending.front ()->done) work_done.wait (l);
+				write_block (pending.front ());
+				pending.pop_front ();
+			}
+			stopping = true;
+			work_ready.notify_all ();
+		}
+		for (size_t i = 0; i < workers.size (); i++) workers[i].join ();
+		workers.clear ();
+		uint32_t end[2] = { 0, 0 };
+		if (fwrite (end, sizeof end, 1, out) != 1) ok = false;
+	}
+	if (fflush (out) != 0) ok = false;
+	return ok;
+}
+
+container_reader::container_reader (FILE *in, bool seekable)
+	: passed (0), in (in), seekable (seekable), version (0), coder (NULL), decoder (NULL), left (0) {
+	uint32_t header[2];
+	if (fread (header, sizeof header, 1, in) != 1
+	 || (header[0] != CONTAINER_ZLIB && header[0] != CONTAINER_CODED)
+	 || header[1] == 0 || header[1] > CONTAINER_MAX_BLOCK) return;
+	version = header[0];
+	block_size = header[1];
+	if (version == CONTAINER_CODED) coder = new trace_coder;
+}
+
+container_reader::~container_reader (void) {
+	delete decoder;
+	delete coder;
+}
+
+// read the next block's header: the bytes of stream in it and of
+// compressed data that follow.  false at the end marker.
+
+bool container_reader::read_header (uint32_t &length, uint32_t &compressed) {
+	uint32_t header[2];
+	if (fread (header, sizeof header, 1, in) != 1) {
+		fprintf (stderr, "container ends without an end marker\n");
+		exit (1);
+	}
+	if (header[0] == 0) return false;
+	if (header[0] > block_size || header[1] > compressBound (block_size) + block_size) {
+		fprintf (stderr, "bad container block\n");
+		exit (1);
+	}
+	length = header[0];
+	compressed = header[1];
+	return true;
+}
+
+bool container_reader::next (uint32_t context, uint64_t skip) {
+	uint32_t length, compressed;
+	passed = 0;
+	if (version == CONTAINER_ZLIB || left == 0) {
+		delete decoder;
+		decoder = NULL;
+		for (;;) {
+			if (!read_header (length, compressed)) return false;
+			if (length > skip) break;
+			packed.resize (compressed);
+			if (compressed && (seekable ? fseek (in, compressed, SEEK_CUR) != 0 : fread (&packed[0], compressed, 1, in) != 1)) {
+				fprintf (stderr, "container ends in the middle of a block\n");
+				exit (1);
+			}
+			passed += length;
+			skip -= length;
+		}
+		packed.resize (compressed);
+		if (compressed && fread (&packed[0], compressed, 1, in) != 1) {
+			fprintf (stderr, "container ends in the middle of a block\n");
+			exit (1);
+		}
+		if (version == CONTAINER_ZLIB) {
+			data.resize (length);
+			uLongf n = length;
+			if (uncompress (&data[0], &n, &packed[0], compressed) != Z_OK || n != length) {
+				fprintf (stderr, "corrupt container block\n");
+				exit (1);
+			}
+			return true;
+		}
+		decoder = new range_decoder (packed.data (), packed.size ());
+		coder->reset ();
+		left = length;
+	}
+	unsigned char unit[CODER_MAX_UNIT];
+	uint32_t n = coder->unit (*decoder, context, unit);
+	if (n > left) {
+		fprintf (stderr, "corrupt container block\n");
+		exit (1);
+	}
+	data.assign (unit, unit + n);
+	left -= n;
+	return true;
+}
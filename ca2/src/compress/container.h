@@ -0,0 +1,162 @@
+// container.h
+// This file declares the compressed trace container.  ct's pre-processed
+// byte stream is cut into blocks of at most a fixed size, and each block
+// is compressed on its own, so blocks can be compressed in parallel.
+//
+// The container is a 12-byte header followed by the blocks:
+//	"CBPZ"			magic
+//	uint32_t version	1 or 2
+//	uint32_t block_size	most bytes of stream per block
+// and each block is
+//	uint32_t length		bytes of stream in the block
+//	uint32_t packed		bytes of compressed data that follow
+//	unsigned char data[packed]
+// with a block of length 0 and no data at the end.  All integers are
+// little-endian.  src/trace.cc reads containers with the same reader.
+//
+// In version 1 the data is zlib's, and a reader can skip a block without
+// inflating it.  In version 2 it is tracecoder.h's, blocks end between
+// traces, and decoding a block needs the remember predictor's state from
+// the trace before it.  The coder starts afresh in each block, so given
+// that state -- which a trace index keeps for every block, see
+// src/trace.cc -- a reader can skip to a block without decoding the
+// ones before it.
+
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tracecoder.h"
+
+#define CONTAINER_MAGIC		"CBPZ"
+#define CONTAINER_BLOCK_SIZE	(4 << 20)
+#define CONTAINER_MAX_BLOCK	(64 << 20)
+
+// the versions, by how their blocks are compressed
+
+enum {
+	CONTAINER_ZLIB = 1,
+	CONTAINER_CODED = 2
+};
+
+// collects the stream and writes it to a file, either as a container or,
+// with threads == 0, as plain bytes for an external compressor.  level is
+// zlib's, for version 1.
+
+class container_writer {
+public:
+	container_writer (FILE *out, int threads, int version = CONTAINER_CODED, int level = 6, uint32_t block_size = CONTAINER_BLOCK_SIZE);
+	~container_writer (void);
+
+	// a version 2 container needs to know where each trace starts and
+	// the target of the trace before it
+
+	void begin_trace (uint32_t context) {
+		if (version != CONTAINER_CODED || workers.empty ()) return;
+		if (fill->raw.size () + CODER_MAX_UNIT > block_size) submit ();
+		fill->contexts.push_back (context);
+	}
+
+	void put (const void *p, size_t n) {
+		const unsigned char *b = (const unsigned char *) p;
+		if (version == CONTAINER_CODED && !workers.empty ()) {
+			fill->raw.insert (fill->raw.end (), b, b + n);
+			return;
+		}
+		while (n) {
+			size_t k = block_size - fill->raw.size ();
+			if (k > n) k = n;
+			fill->raw.insert (fill->raw.end (), b, b + k);
+			b += k;
+			n -= k;
+			if (fill->raw.size () == block_size) submit ();
+		}
+	}
+
+	// write out everything still pending and the end marker; returns
+	// false on a write error
+
+	bool finish (void);
+
+private:
+	struct block {
+		std::vector<unsigned char> raw, packed;
+		std::vector<uint32_t> contexts;
+		bool done;
+	};
+
+	FILE *out;
+	int version, level;
+	uint32_t block_size;
+	bool ok;
+
+	// blocks in stream order; the front is the next to be written.
+	// workers compress them in the same order they were queued.
+	std::deque<block *> pending;
+	std::deque<block *> queue;
+	std::vector<block *> spare;
+	block *fill;
+	size_t max_pending;
+
+	std::vector<std::thread> workers;
+	std::mutex m;
+	std::condition_variable work_ready, work_done;
+	bool stopping;
+
+	void submit (void);
+	void write_block (block *b);
+	void compress (block *b, trace_coder *coder);
+	void worker (void);
+};
+
+// reads a container back as the stream, a block at a time for version 1
+// and a trace at a time for version 2
+
+class container_reader {
+public:
+	// in must be positioned just past the magic.  seekable says in is a
+	// regular file, so blocks passed over need not be read.
+	explicit container_reader (FILE *in, bool seekable = false);
+	~container_reader (void);
+
+	// whether the header was good; the reader is no use otherwise
+	bool good (void) const { return version != 0; }
+
+	// the version, which says how the blocks are compressed
+	uint32_t format (void) const { return version; }
+
+	// put the next piece of the stream into data, given the target of
+	// the last trace read; false at the end.  whole blocks that fit in
+	// the next skip bytes are passed over first -- in version 2 only
+	// between blocks -- and passed is the bytes of stream they held.
+	bool next (uint32_t context, uint64_t skip = 0);
+
+	// whether the last piece ended a version 2 block, so the next trace
+	// starts one
+	bool block_end (void) const { return version == CONTAINER_CODED && left == 0; }
+
+	std::vector<unsigned char> data;
+	uint64_t passed;
+
+private:
+	FILE *in;
+	bool seekable;
+	uint32_t version, block_size;
+	std::vector<unsigned char> packed;
+
+	// for version 2, the bytes left in the current block
+	trace_coder *coder;
+	range_decoder *decoder;
+	uint32_t left;
+
+	bool read_header (uint32_t &length, uint32_t &compressed);
+};
+
+#endif // CONTAINER_H
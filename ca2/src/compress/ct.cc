@@ -1,33 +1,69 @@
+// ct.cc
+// Usage: ct [-j threads] [-z] [-l level] [-b bytes] [-p] ( -c | -d ) <filename>...
+//	-c		pre-process raw traces
+//	-d		turn pre-processed traces back into raw ones
+//	-j threads	compression threads (default: one per core)
+//	-z		with -c, compress blocks with zlib (version 1) rather
+//			than with the entropy coder (version 2)
+//	-l level	zlib level, 1 (fast) to 9 (small) (default 6)
+//	-b bytes	most bytes of pre-processed stream per block (default
+//			4M); smaller blocks compress a little worse, but a
+//			trace index can start a reader at more places
+//	-p		with -c, write the plain pre-processed stream, for
+//			an external compressor, instead of a container
+// With -c the output is a compressed container (see container.h) unless
+// -p is given.  With -d the output is always the plain raw traces.  Input
+// may be plain, gzip, bzip2 or a container.
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 #include <zlib.h>
 #include <map>
+#include <thread>
 
 #include "branch.h"
 #include "trace.h"
+#include "container.h"
 
 bool compressing = false;
+container_writer *output;
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-j threads] [-z] [-l level] [-b bytes] [-p] [ -d | -c ] <filename>.gz\n", prog);
+	exit (1);
+}
 
 int main (int argc, char *argv[]) {
 	long long int ntraces = 0;
-	if (argc < 3) {
-		fprintf (stderr, "Usage: %s [ -d | -c ] <filename>.gz\n", argv[0]);
-		exit (1);
-	}
-	if (strcmp (argv[1], "-c") == 0) {
-		compressing = true;
-	} else if (strcmp (argv[1], "-d") == 0) {
-		compressing = false;
-	} else {
-		fprintf (stderr, "Usage: %s [ -d | -c ] <filename>.gz\n", argv[0]);
-		exit (1);
+	int threads = std::thread::hardware_concurrency ();
+	int level = 6, version = CONTAINER_CODED;
+	long block_size = CONTAINER_BLOCK_SIZE;
+	bool plain = false, chosen = false;
+	int c;
+
+	while ((c = getopt (argc, argv, "b:cdj:l:pz")) != -1) {
+		switch (c) {
+		case 'b': block_size = atol (optarg); break;
+		case 'c': compressing = true; chosen = true; break;
+		case 'd': compressing = false; chosen = true; break;
+		case 'j': threads = atoi (optarg); break;
+		case 'l': level = atoi (optarg); break;
+		case 'p': plain = true; break;
+		case 'z': version = CONTAINER_ZLIB; break;
+		default: usage (argv[0]);
+		}
 	}
-	for (int i=2; i<argc; i++) {
+	if (!chosen || optind == argc || level < 1 || level > 9
+	 || block_size < CODER_MAX_UNIT || block_size > CONTAINER_MAX_BLOCK) usage (argv[0]);
+	if (threads < 1) threads = 1;
+	output = new container_writer (stdout, compressing && !plain ? threads : 0, version, level, (uint32_t) block_size);
+	for (int i=optind; i<argc; i++) {
 		fprintf (stderr, "reading \"%s\"\n", argv[i]);
 		fflush (stderr);
 		init_trace (argv[i]);
-		long long int tmiss = 0, dmiss = 0, branches = 0;
 		for (;;) {
 			trace *t = read_trace ();
 			if (!t) break;
@@ -35,6 +71,11 @@ int main (int argc, char *argv[]) {
 		}
 		end_trace ();
 	}
+	if (!output->finish ()) {
+		perror ("writing output");
+		exit (1);
+	}
+	delete output;
 	fprintf (stderr, "%lld traces\n", ntraces);
 	exit (0);
 }
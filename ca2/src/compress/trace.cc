@@ -6,11 +6,16 @@
 
 #include "branch.h"
 #include "trace.h"
+#include "container.h"
 
 #define BUFSIZE	10000000
 
 extern bool compressing;
 
+// where the output stream goes (see ct.cc)
+
+extern container_writer *output;
+
 FILE *tracefp;
 
 #define ZCAT		"/bin/gzip -dc"
@@ -19,21 +24,34 @@ FILE *tracefp;
 
 unsigned char buf[BUFSIZE];
 unsigned int bufpos, bufsize;
+
+// the input, if it is a container, and the bytes being read: buf or the
+// container's current block
+
+container_reader *reader;
+unsigned char *bytes = buf;
 bool end_of_file;
 long long int Total_bytes = 0;
 
+static unsigned int last_target (void);
+
 unsigned char read_byte (void) {
 	if (bufpos == bufsize) {
 		bufpos = 0;
-		bufsize = fread (buf, 1, BUFSIZE, tracefp);
-		fprintf (stderr, "read %d bytes\n", bufsize);
+		if (reader) {
+			bufsize = reader->next (last_target ()) ? reader->data.size () : 0;
+			bytes = &reader->data[0];
+		} else {
+			bufsize = fread (buf, 1, BUFSIZE, tracefp);
+		}
+		if (!reader) fprintf (stderr, "read %d bytes\n", bufsize);
 		if (bufsize == 0) {
 			end_of_file = true;
 			return 0;
 		}
 	}
 	Total_bytes++;
-	return buf[bufpos++];
+	return bytes[bufpos++];
 }
 
 unsigned int read_uint (void) {
@@ -104,6 +122,12 @@ remember rtab[N_REMEMBER][ASSOC];
 static unsigned int now = 0;
 static remember last_one;
 
+// the context a version 2 container codes the next trace in
+
+static unsigned int last_target (void) {
+	return last_one.target;
+}
+
 remember *predict_remember (void) {
 	unsigned int index = last_one.target & (N_REMEMBER-1);
 	remember *r = &rtab[index][0];
@@ -144,16 +168,16 @@ trace *read_trace (void) {
 	// pass along instruction counts unchanged (we don't care)
 	if (c == 0x87) {
 		int x = 0, y = 0;
-		fwrite (&c, 1, 1, stdout);
+		output->put (&c, 1);
 		c = read_byte ();
 		x = c;
-		fwrite (&c, 1, 1, stdout);
+		output->put (&c, 1);
 		c = read_byte ();
 		y = c;
 		y <<= 8;
 		x |= y;
 		//fprintf (stderr, "%d more insts\n", x);
-		fwrite (&c, 1, 1, stdout);
+		output->put (&c, 1);
 		c = read_byte ();
 	}
 	if (compressing) {
@@ -167,6 +191,7 @@ trace *read_trace (void) {
 	bool correct;
 	if (compressing) {
 		assert ((c & 0x80) == 0);
+		output->begin_trace (last_one.target);
 		remember r(c, t.bi.address, t.target, t.taken);
 		remember *p = predict_remember ();
 		bool ras_correct = false;
@@ -200,19 +225,19 @@ trace *read_trace (void) {
 			if (ras_correct) index += ASSOC;
 			if (ras_offby2) {
 				out = 0x82;
-				fwrite (&out, 1, 1, stdout);
+				output->put (&out, 1);
 			} else if (ras_offby3) {
 				out = 0x83;
-				fwrite (&out, 1, 1, stdout);
+				output->put (&out, 1);
 			}
 			out = (unsigned char) index;
-			fwrite (&out, 1, 1, stdout);
+			output->put (&out, 1);
 			nright++; 
 			total_bytes++;
 		} else {
-			fwrite (&c, 1, 1, stdout);
-			fwrite (&t.bi.address, 4, 1, stdout);
-			fwrite (&t.target, 4, 1, stdout);
+			output->put (&c, 1);
+			output->put (&t.bi.address, 4);
+			output->put (&t.target, 4);
 			total_bytes += 1 + 4 + 4;
 			trace_bytes += 1 + 4 + 4;
 		}
@@ -278,9 +303,9 @@ trace *read_trace (void) {
 			}
 			update_remember (r, p, false, -1);
 		}
-		fwrite (&c, 1, 1, stdout);
-		fwrite (&t.bi.address, 4, 1, stdout);
-		fwrite (&t.target, 4, 1, stdout);
+		output->put (&c, 1);
+		output->put (&t.bi.address, 4);
+		output->put (&t.target, 4);
 	}
 	t.bi.opcode = c & 15;
 	c >>= 4;
@@ -319,8 +344,8 @@ trace *read_trace (void) {
 #define BZIP2_MAGIC	"BZ"
 
 void init_trace (char *fname) {
-	char *dc;
-	char s[2] = { 0, 0 };
+	const char *dc;
+	char s[4] = { 0, 0, 0, 0 };
 	char cmd[1000];
 
 	// figure out the compression method from the magic number
@@ -332,8 +357,21 @@ void init_trace (char *fname) {
 	FILE *f = fopen (fname, "r");
 	if (!f) {
 		perror (fname);
+		exit (1);
 	}
-	fread (s, 1, 2, f);
+	fread (s, 1, 4, f);
+	if (memcmp (s, CONTAINER_MAGIC, 4) == 0) {
+
+		// our own container is read in-process
+
+		fprintf (stderr, "CBPZ\n");
+		tracefp = f;
+		reader = new container_reader (f);
+		if (!reader->good ()) {
+			fprintf (stderr, "%s: bad container header\n", fname);
+			exit (1);
+		}
+	} else {
 	fclose (f);
 	if (strncmp (s, GZIP_MAGIC, 2) == 0) 
 		fprintf (stderr, "GZIP\n"), dc = ZCAT;
@@ -354,6 +392,7 @@ void init_trace (char *fname) {
 		exit (1);
 	}
 	}
+	}
 	bufpos = 0;
 	bufsize = 0;
 	end_of_file = false;
@@ -364,5 +403,10 @@ void init_trace (char *fname) {
 
 void end_trace (void) {
 	if (compressing) fprintf (stderr, "pred rate: %f ; trace bytes rate: %f\n", nright / (double) ntimes, trace_bytes / (double) total_bytes);
-	if (tracefp != stdin) pclose (tracefp);
+	if (reader) {
+		delete reader;
+		reader = NULL;
+		bytes = buf;
+		fclose (tracefp);
+	} else if (tracefp != stdin) pclose (tracefp);
 }
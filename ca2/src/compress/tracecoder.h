@@ -0,0 +1,338 @@
+// tracecoder.h
+// This file contains the entropy coder of version 2 containers (see
+// container.h).  Each unit of the pre-processed stream -- the one, two or
+// nine bytes ct writes for a trace -- is coded with a binary arithmetic
+// coder whose probabilities come from adaptive context models.  The
+// models are keyed on the remember predictor's state, which the coder is
+// told for every unit: the previous trace's target, which selects the
+// set of rtab the set index refers to.  One model looks at that set
+// alone and another at the path of the 16 sets before it, and a small
+// logistic mixer combines them.
+//
+// A set index is coded first as "the same as the last index coded for
+// this set", which is right about nine times in ten, then as "the same
+// as the one before that", and only otherwise bit by bit.  RAS fixups
+// are two more symbols of the same alphabet.  The code byte, address
+// and target of a miss record are coded a byte at a time against the
+// previous miss.
+//
+// The encoder and decoder run the same code (see unit), so they cannot
+// drift apart.  All arithmetic is integer.
+
+#ifndef TRACECODER_H
+#define TRACECODER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// parameters of the models; the sets must match N_REMEMBER in trace.cc
+
+#define CODER_ORDERS	2
+#define CODER_BITS	16
+#define CODER_SETS	(1<<16)
+#define CODER_PATH	16
+
+// the largest unit: a RAS fixup prefix and a miss record
+
+#define CODER_MAX_UNIT	10
+
+// symbols of a unit's first byte: 0..15 are set indices as ct writes them
+
+enum {
+	SYMBOL_OFFBY2 = 16,	// 0x82
+	SYMBOL_OFFBY3,		// 0x83
+	SYMBOL_MISS		// any other byte, the code of a miss record
+};
+
+// a carry-less binary arithmetic coder with 12-bit probabilities, after
+// the one in lpaq1.  code() takes the probability that the bit is 1.
+
+class range_encoder {
+public:
+	explicit range_encoder(std::vector<unsigned char> &out) : out(out), x1(0), x2(0xffffffff) {
+	}
+
+	int code(int bit, int p) {
+		uint32_t xmid = x1 + (uint32_t) (((uint64_t) (x2 - x1) * p) >> 12);
+		if (bit) x2 = xmid;
+		else x1 = xmid + 1;
+		while (((x1 ^ x2) & 0xff000000) == 0) {
+			out.push_back(x2 >> 24);
+			x1 <<= 8;
+			x2 = (x2 << 8) | 255;
+		}
+		return bit;
+	}
+
+	void flush(void) {
+		for (int i = 0; i < 4; i++) {
+			out.push_back(x1 >> 24);
+			x1 <<= 8;
+		}
+	}
+
+private:
+	std::vector<unsigned char> &out;
+	uint32_t x1, x2;
+};
+
+class range_decoder {
+public:
+	range_decoder(const unsigned char *p, size_t n) : p(p), end(p + n), x1(0), x2(0xffffffff), x(0) {
+		for (int i = 0; i < 4; i++) x = (x << 8) | next();
+	}
+
+	// the bit passed in is ignored
+
+	int code(int, int p) {
+		uint32_t xmid = x1 + (uint32_t) (((uint64_t) (x2 - x1) * p) >> 12);
+		int bit = x <= xmid;
+		if (bit) x2 = xmid;
+		else x1 = xmid + 1;
+		while (((x1 ^ x2) & 0xff000000) == 0) {
+			x1 <<= 8;
+			x2 = (x2 << 8) | 255;
+			x = (x << 8) | next();
+		}
+		return bit;
+	}
+
+private:
+	const unsigned char *p, *end;
+	uint32_t x1, x2, x;
+
+	unsigned char next(void) {
+		return p < end ? *p++ : 0;
+	}
+};
+
+class trace_coder {
+public:
+	trace_coder(void) : same(CODER_ORDERS << CODER_BITS), sets(CODER_ORDERS << CODER_BITS), miss(MISS_SIZE) {
+		int pi = 0;
+		for (int x = -2047; x <= 2047; x++) {
+			int v = squash(x);
+			squashed[x + 2047] = v;
+			for (int j = pi; j <= v; j++) stretch[j] = x;
+			pi = v + 1;
+		}
+		for (int j = pi; j < 4096; j++) stretch[j] = 2047;
+		for (int o = 0; o < CODER_ORDERS; o++) {
+			power[o] = 1;
+			for (int j = 0; j < lengths[o]; j++) power[o] *= ROLL;
+		}
+		reset();
+	}
+
+	// forget everything; each block of a container starts afresh
+
+	void reset(void) {
+		for (size_t i = 0; i < same.size(); i++) same[i] = 2048;
+		for (size_t i = 0; i < sets.size(); i++)
+			for (int j = 0; j < 32; j++) sets[i].p[j] = 2048;
+		for (size_t i = 0; i < miss.size(); i++) miss[i] = 2048;
+		for (int i = 0; i < 32 * (CODER_ORDERS + 1); i++) weights[i] = 1 << 14;
+		memset(last, 0, sizeof last);
+		memset(path, 0, sizeof path);
+		memset(rolling, 0, sizeof rolling);
+		memset(last_address, 0, sizeof last_address);
+		path_pos = 0;
+		last_symbol = 0;
+		last_code = 0;
+	}
+
+	// code one unit, given the target of the trace before it.  when
+	// encoding, the unit is read from bytes; when decoding it is written
+	// there.  returns the unit's length.
+
+	template <class C>
+	int unit(C &c, uint32_t context, unsigned char *bytes) {
+		select(context);
+		int n = 0, s;
+		for (int i = 0;; i++) {
+			s = symbol(c, symbol_of(bytes[n]));
+			if (i == 0) {
+				last[set][1] = last[set][0];
+				last[set][0] = s;
+				last_symbol = s;
+			}
+			if (s < SYMBOL_OFFBY2) {
+				bytes[n++] = s;
+				return n;
+			}
+			if (s == SYMBOL_MISS) break;
+			bytes[n++] = s == SYMBOL_OFFBY2 ? 0x82 : 0x83;
+			if (i) return n;
+		}
+
+		// a miss record: the code, then the address and target, each
+		// little-endian
+
+		unsigned char *b = bytes + n;
+		b[0] = byte(c, &miss[MISS_CODE + last_code * 256], b[0]);
+		last_code = b[0];
+		for (int j = 3; j >= 0; j--)
+			b[1+j] = byte(c, &miss[MISS_ADDRESS + (j * 256 + last_address[j]) * 256], b[1+j]);
+		int same = 1;
+		for (int j = 3; j >= 0; j--) {
+			b[5+j] = byte(c, &miss[MISS_TARGET + ((j * 256 + b[1+j]) * 2 + same) * 256], b[5+j]);
+			same &= b[5+j] == b[1+j];
+		}
+		memcpy(last_address, b + 1, 4);
+		return n + 9;
+	}
+
+	// the length of the unit at p, of at most n bytes, or 0 if it is cut
+	// off; the encoder uses this to walk a block
+
+	static int unit_length(const unsigned char *p, size_t n) {
+		size_t k = 0;
+		if (n && (p[0] == 0x82 || p[0] == 0x83)) k++;
+		if (k == n) return 0;
+		if (k && (p[k] == 0x82 || p[k] == 0x83)) k += 1;
+		else k += p[k] < 16 ? 1 : 9;
+		return k <= n ? (int) k : 0;
+	}
+
+private:
+	enum {
+		MISS_CODE = 0,
+		MISS_ADDRESS = MISS_CODE + 256 * 256,
+		MISS_TARGET = MISS_ADDRESS + 4 * 256 * 256,
+		MISS_SIZE = MISS_TARGET + 4 * 256 * 2 * 256
+	};
+
+	// one context of one model: the probability that the symbol is the
+	// same as last time, and for when it is not, that it is the same as
+	// the time before (node 0) and of a binary tree over the 32 symbols.
+	// the first are kept apart, and small enough to stay in cache, since
+	// they are nearly all that is used.
+
+	struct slot {
+		uint16_t p[32];
+	} __attribute__((aligned(64)));
+
+	std::vector<uint16_t> same;
+	std::vector<slot> sets;
+	std::vector<uint16_t> miss;
+	int32_t weights[32 * (CODER_ORDERS + 1)];
+	int16_t stretch[4096], squashed[4095];
+
+	// the last two symbols of each set, the path of recent sets and
+	// symbols with a rolling hash of the last lengths[o] of it for each
+	// model, and the last miss record
+
+	unsigned char last[CODER_SETS][2];
+	uint32_t path[CODER_PATH];
+	int path_pos;
+	uint32_t rolling[CODER_ORDERS], power[CODER_ORDERS];
+	static constexpr int lengths[CODER_ORDERS] = { 0, CODER_PATH };
+	static const uint32_t ROLL = 0x01000193;
+	int last_symbol;
+	unsigned char last_code, last_address[4];
+
+	// the current unit's set and contexts
+
+	unsigned int set;
+	uint32_t index[CODER_ORDERS];
+
+	static int symbol_of(unsigned char b) {
+		if (b < 16) return b;
+		if (b == 0x82) return SYMBOL_OFFBY2;
+		if (b == 0x83) return SYMBOL_OFFBY3;
+		return SYMBOL_MISS;
+	}
+
+	// 1 / (1 + exp(-d)), d and the result scaled by 256 and 4096
+
+	static int squash(int d) {
+		static const int t[33] = {
+			1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101,
+			1546, 2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4022,
+			4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094 };
+		if (d > 2047) return 4095;
+		if (d < -2047) return 1;
+		int w = d & 127;
+		d = (d >> 7) + 16;
+		return (t[d] * (128 - w) + t[d+1] * w + 64) >> 7;
+	}
+
+	static uint32_t hash(uint32_t x, uint32_t y) {
+		return (x ^ y) * 0x9e3779b1u + 0x7f4a7c15u;
+	}
+
+	// find the contexts of the unit that follows the given target
+
+	void select(uint32_t context) {
+		uint32_t e = context ^ (uint32_t) last_symbol << 27;
+		set = context & (CODER_SETS - 1);
+		uint32_t h = hash(context, last[set][0] | last[set][1] << 5);
+		index[0] = h >> (32 - CODER_BITS);
+		for (int o = 1; o < CODER_ORDERS; o++) {
+			uint32_t out = path[(path_pos - lengths[o]) & (CODER_PATH - 1)];
+			rolling[o] = rolling[o] * ROLL + e - out * power[o];
+			uint32_t g = hash(h, rolling[o] + o);
+			index[o] = (o << CODER_BITS) + (g >> (32 - CODER_BITS));
+		}
+		path[path_pos++ & (CODER_PATH - 1)] = e;
+	}
+
+	// code one binary decision at a node of the symbol tree, given each
+	// model's probabilities
+
+	template <class C>
+	int mix(C &c, uint16_t *const *ctx, int node, int bit) {
+		int st[CODER_ORDERS + 1];
+		int32_t *w = &weights[node * (CODER_ORDERS + 1)];
+		int64_t dot = 0;
+		for (int o = 0; o < CODER_ORDERS; o++) {
+			st[o] = stretch[ctx[o][node]];
+			dot += (int64_t) w[o] * st[o];
+		}
+		st[CODER_ORDERS] = 256;
+		dot += (int64_t) w[CODER_ORDERS] * 256;
+		int d = (int) (dot >> 16);
+		int p = squashed[d < -2047 ? 0 : d > 2047 ? 4094 : d + 2047];
+		bit = c.code(bit, p);
+		int err = (bit << 12) - p;
+		for (int o = 0; o <= CODER_ORDERS; o++) w[o] += (st[o] * err) >> 10;
+		for (int o = 0; o < CODER_ORDERS; o++) {
+			uint16_t &q = ctx[o][node];
+			if (bit) q += (4096 - q) >> 3;
+			else q -= q >> 3;
+		}
+		return bit;
+	}
+
+	template <class C>
+	int symbol(C &c, int s) {
+		uint16_t *ctx[CODER_ORDERS];
+		int e = last[set][0];
+		for (int o = 0; o < CODER_ORDERS; o++) ctx[o] = &same[index[o]];
+		if (mix(c, ctx, 0, s == e)) return e;
+		for (int o = 0; o < CODER_ORDERS; o++) ctx[o] = sets[index[o]].p;
+		int e1 = last[set][1];
+		if (e1 != e && mix(c, ctx, 0, s == e1)) return e1;
+		int node = 1;
+		for (int i = 4; i >= 0; i--) node = node * 2 + mix(c, ctx, node, (s >> i) & 1);
+		return node - 32;
+	}
+
+	// code a byte with an adaptive binary tree
+
+	template <class C>
+	static unsigned char byte(C &c, uint16_t *t, unsigned char b) {
+		int node = 1;
+		for (int i = 7; i >= 0; i--) {
+			uint16_t &q = t[node];
+			int bit = c.code((b >> i) & 1, q);
+			if (bit) q += (4096 - q) >> 4;
+			else q -= q >> 4;
+			node = node * 2 + bit;
+		}
+		return node - 256;
+	}
+};
+
+#endif // TRACECODER_H
@@ -0,0 +1,147 @@
+// corrector.h
+// This file declares the statistical corrector, an optional side
+// component of TAGE in the style of TAGE-SC.  TAGE is very good at
+// branches that correlate strongly with some history, but poor at
+// branches that are only statistically biased.  The corrector is a small
+// GEHL-style adder tree: a bias table indexed by the branch and TAGE's
+// prediction, and tables indexed by short global histories, all of signed
+// counters.  Their sum, plus a term for TAGE's own confidence, decides
+// whether to overturn TAGE.
+//
+// Given a local history (see local.h), as TAGE-SC-L gives it, the tree
+// grows two more tables, indexed by half and by all of the branch's local
+// history; they catch the branches whose pattern is their own.
+
+#ifndef CORRECTOR_H
+#define CORRECTOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "local.h"
+
+class statistical_corrector {
+public:
+	static const int TABLE_COUNT = 4; // the bias table and three history tables
+	static const int LOCAL_TABLE_COUNT = 2;
+	static const uint32_t INDEX_LENGTH = 10;
+	static const uint32_t TABLE_SIZE = 1 << INDEX_LENGTH;
+	static const int COUNTER_BITS = 6;
+	static const int COUNTER_MAX = (1 << (COUNTER_BITS - 1)) - 1;
+	static const int COUNTER_MIN = -(1 << (COUNTER_BITS - 1));
+
+	// modeled bits: the tables, the threshold and its 7-bit counter
+	static const uint64_t STORAGE_BITS = (uint64_t) TABLE_COUNT * TABLE_SIZE * COUNTER_BITS + 7 + 7;
+	static const uint64_t LOCAL_STORAGE_BITS = (uint64_t) LOCAL_TABLE_COUNT * TABLE_SIZE * COUNTER_BITS;
+
+	statistical_corrector(void) : local(NULL), sum(0), threshold(6), threshold_counter(0), tage_pred(false), sc_pred(false) {
+		memset(tables, 0, sizeof tables);
+		memset(local_tables, 0, sizeof local_tables);
+	}
+
+	// keep the folds predict() reads up to date in h (see history.h)
+
+	template <class History>
+	void track(History &h) {
+		for (int i = 1; i < TABLE_COUNT; i++) {
+			h.track(HISTORY_LENGTH[i], INDEX_LENGTH);
+		}
+	}
+
+	// confidence is TAGE's provider confidence, 0 for a weak counter.
+	// local, if not NULL, is the local history to index the local tables
+	// with; the owner updates it after update().
+
+	template <class History>
+	bool predict(uint32_t pc, bool tage, int confidence, const History &h, const local_history *l = NULL) {
+		local = l;
+		tage_pred = tage;
+		index[0] = (pc ^ (pc >> INDEX_LENGTH) ^ (tage << (INDEX_LENGTH - 1)) ^ (confidence == 0)) & (TABLE_SIZE - 1);
+		for (int i = 1; i < TABLE_COUNT; i++) {
+			index[i] = (pc ^ (pc >> (INDEX_LENGTH - i)) ^ h.foldHistory(HISTORY_LENGTH[i], INDEX_LENGTH) ^ (tage << i))
+			         & (TABLE_SIZE - 1);
+		}
+
+		sum = (tage ? 1 : -1) * (2 * confidence + 1) * 8;
+		for (int i = 0; i < TABLE_COUNT; i++) {
+			sum += 2 * tables[i][index[i]] + 1;
+		}
+		if (local) {
+			for (int i = 0; i < LOCAL_TABLE_COUNT; i++) {
+				int n = (i + 1) * local->historyLength() / LOCAL_TABLE_COUNT;
+				local_index[i] = (pc ^ (pc >> (INDEX_LENGTH - 4 - i)) ^ local->foldHistory(pc, n, INDEX_LENGTH) ^ (tage << (i + 4)))
+				               & (TABLE_SIZE - 1);
+				sum += 2 * local_tables[i][local_index[i]] + 1;
+			}
+		}
+		sc_pred = sum >= 0;
+
+		// only overturn TAGE when the tables agree strongly
+		if (sc_pred != tage_pred && abs(sum) >= threshold) {
+			return sc_pred;
+		}
+		return tage_pred;
+	}
+
+	void update(bool taken) {
+		if (sc_pred != taken || abs(sum) < threshold) {
+			for (int i = 0; i < TABLE_COUNT; i++) {
+				train(tables[i][index[i]], taken);
+			}
+			for (int i = 0; local && i < LOCAL_TABLE_COUNT; i++) {
+				train(local_tables[i][local_index[i]], taken);
+			}
+		}
+
+		// adapt the threshold so updates track mispredictions
+		if (sc_pred != tage_pred) {
+			if (sc_pred != taken) {
+				if (++threshold_counter > 63) {
+					threshold_counter = 0;
+					threshold++;
+				}
+			} else if (--threshold_counter < -64) {
+				threshold_counter = 0;
+				if (threshold > 1) threshold--;
+			}
+		}
+	}
+
+	// the local tables are only written with a local history, so a
+	// geometry without one reads and writes what it always has
+
+	template <class IO>
+	void serialize(IO &io, bool with_local = false) {
+		io.pod(tables);
+		io.pod(threshold);
+		io.pod(threshold_counter);
+		if (with_local) {
+			io.pod(local_tables);
+		}
+	}
+
+private:
+	static constexpr int HISTORY_LENGTH[TABLE_COUNT] = {0, 4, 11, 27};
+
+	int8_t tables[TABLE_COUNT][TABLE_SIZE];
+	int8_t local_tables[LOCAL_TABLE_COUNT][TABLE_SIZE];
+	uint32_t index[TABLE_COUNT];
+	uint32_t local_index[LOCAL_TABLE_COUNT];
+	const local_history *local; // the current branch's, or NULL
+	int sum;
+	int threshold;
+	int threshold_counter;
+	bool tage_pred;
+	bool sc_pred;
+
+	static void train(int8_t &c, bool taken) {
+		if (taken && c < COUNTER_MAX) {
+			c++;
+		} else if (!taken && c > COUNTER_MIN) {
+			c--;
+		}
+	}
+};
+
+#endif // CORRECTOR_H
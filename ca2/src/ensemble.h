@@ -0,0 +1,260 @@
+// ensemble.h
+// This file declares ensembles: several direction predictors run side by
+// side on one global history, with a chooser that turns their predictions
+// into one.  A component is any class with
+//
+//	bool predict (uint32_t pc);
+//	void update (uint32_t pc, bool taken);	// before the outcome is pushed
+//	void storage (storage_report &) const;
+//	template <class IO> void serialize (IO &);
+//
+// and a constructor taking (global_history &, uint32_t seed), a
+// global_history & alone, or nothing: bimodal_table, gshare, perceptron,
+// local_predictor and Tage all are.  Every component reads the one
+// history the ensemble owns and pushes each outcome into, and so does
+// the target subsystem.
+//
+// A chooser is a class template on the number of components with
+//
+//	bool predict (uint32_t pc, const bool *predictions, int &provider);
+//	void update (uint32_t pc, const bool *predictions, bool taken);
+//
+// and storage () and serialize () as above.  provider is the component
+// the chooser credits with the prediction, and becomes the update's
+// provider, so the profile (-P, -D) and interval series (-i) of predict
+// show how often each component decided a branch and how often it was
+// right.
+//
+// An ensemble is built from its types, so every component call inlines;
+// the registry (registry.cc) names the combinations predict can run.
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "branch.h"
+#include "predictor.h"
+#include "storage.h"
+#include "history.h"
+#include "target.h"
+#include "xorshift.h"
+
+// per-branch meta counters: a 2-bit counter per component for each of a
+// table of branches, counting up when the component was right and down
+// when it was wrong, on the branches where the components disagreed.  the
+// component with the highest counter decides, the later one on a tie, so
+// with bimodal and gshare this is the classic tournament.
+
+template <int N>
+class meta_chooser {
+public:
+	static const uint32_t INDEX_LENGTH = 12;
+	static const uint32_t SIZE = 1 << INDEX_LENGTH;
+
+	meta_chooser(void) {
+		memset(counters, 1, sizeof counters);
+	}
+
+	bool predict(uint32_t pc, const bool *predictions, int &provider) {
+		const uint8_t *c = counters[pc & (SIZE - 1)];
+		provider = 0;
+		for (int i = 1; i < N; i++) {
+			if (c[i] >= c[provider]) {
+				provider = i;
+			}
+		}
+		return predictions[provider];
+	}
+
+	void update(uint32_t pc, const bool *predictions, bool taken) {
+		bool agree = true;
+		for (int i = 1; i < N; i++) {
+			agree = agree && predictions[i] == predictions[0];
+		}
+		if (agree) {
+			return;
+		}
+		uint8_t *c = counters[pc & (SIZE - 1)];
+		for (int i = 0; i < N; i++) {
+			if (predictions[i] == taken && c[i] < 0b11) {
+				c[i]++;
+			} else if (predictions[i] != taken && c[i] > 0b00) {
+				c[i]--;
+			}
+		}
+	}
+
+	void storage(storage_report &r) const {
+		r.add("meta counters", (uint64_t) SIZE * N * 2);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(counters);
+	}
+
+private:
+	uint8_t counters[SIZE][N]; // 2 bit counters
+};
+
+// a perceptron over the components' votes: per branch, a bias weight and
+// a weight for each component, summed with each component's prediction
+// as +1/-1.  it learns which components to trust for a branch, and can
+// follow a majority none of them makes alone.  the provider is the
+// component whose vote pushed the sum hardest toward the prediction.
+
+template <int N>
+class vote_chooser {
+public:
+	static const uint32_t INDEX_LENGTH = 10;
+	static const uint32_t SIZE = 1 << INDEX_LENGTH;
+	static const int THRESHOLD = 2 * N + 14;
+
+	vote_chooser(void) : sum(0) {
+		memset(weights, 0, sizeof weights);
+	}
+
+	bool predict(uint32_t pc, const bool *predictions, int &provider) {
+		const int8_t *w = weights[pc & (SIZE - 1)];
+		sum = w[N];
+		for (int i = 0; i < N; i++) {
+			sum += predictions[i] ? w[i] : -w[i];
+		}
+		bool pred = sum >= 0;
+		int best = 0;
+		provider = 0;
+		for (int i = 0; i < N; i++) {
+			int vote = predictions[i] == pred ? w[i] : -w[i];
+			if (i == 0 || vote > best) {
+				best = vote;
+				provider = i;
+			}
+		}
+		return pred;
+	}
+
+	void update(uint32_t pc, const bool *predictions, bool taken) {
+		if ((sum >= 0) == taken && abs(sum) > THRESHOLD) {
+			return;
+		}
+		int8_t *w = weights[pc & (SIZE - 1)];
+		for (int i = 0; i < N; i++) {
+			train(w[i], predictions[i] == taken);
+		}
+		train(w[N], taken);
+	}
+
+	void storage(storage_report &r) const {
+		r.add("vote weights", (uint64_t) SIZE * (N + 1) * 8);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(weights);
+	}
+
+private:
+	int8_t weights[SIZE][N + 1]; // one per component, then the bias
+	int sum;
+
+	static void train(int8_t &w, bool up) {
+		if (up && w < 127) {
+			w++;
+		} else if (!up && w > -127) {
+			w--;
+		}
+	}
+};
+
+// build a component with whichever of the constructors it has
+
+template <class C>
+C make_component(global_history &h, uint32_t seed) {
+	if constexpr (std::is_constructible<C, global_history &, uint32_t>::value) {
+		return C(h, seed);
+	} else if constexpr (std::is_constructible<C, global_history &>::value) {
+		return C(h);
+	} else {
+		return C();
+	}
+}
+
+// the ensemble, with the static predictor interface (see simulate.h)
+
+template <template <int> class Chooser, class... Components>
+class ensemble {
+public:
+	static const int COMPONENTS = sizeof...(Components);
+
+	typedef branch_update update_type;
+
+	explicit ensemble(uint32_t seed = DEFAULT_SEED)
+		: components(make_component<Components>(history, seed)...), targets(seed) {
+		targets.track(history);
+	}
+
+	void predict(const branch_info &b, update_type &u) {
+		if (b.br_flags & BR_CONDITIONAL) {
+			int i = 0;
+			std::apply([&](Components &... c) { ((predictions[i++] = c.predict(b.address)), ...); }, components);
+			int provider;
+			u.direction_prediction(chooser.predict(b.address, predictions, provider));
+			u.provider(provider);
+		} else {
+			u.direction_prediction(true);
+		}
+		u.target_prediction(targets.predict(b, history));
+	}
+
+	void update(const branch_info &b, update_type &, bool taken, unsigned int target) {
+		targets.update(b, taken, target);
+		if (b.br_flags & BR_CONDITIONAL) {
+			chooser.update(b.address, predictions, taken);
+			std::apply([&](Components &... c) { (c.update(b.address, taken), ...); }, components);
+		}
+		history.push(!(b.br_flags & BR_CONDITIONAL) || taken);
+	}
+
+	// each component's tables under its number, as the provider counts
+	// number them
+
+	void storage(storage_report &r) const {
+		int i = 0;
+		std::apply([&](const Components &... c) { (componentStorage(i++, c, r), ...); }, components);
+		chooser.storage(r);
+		r.add("global history", history.historyLength(), STORAGE_REGISTER);
+		target_predictor::storage(r);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		std::apply([&](Components &... c) { (c.serialize(io), ...); }, components);
+		chooser.serialize(io);
+		history.serialize(io);
+		targets.serialize(io);
+	}
+
+private:
+	global_history history;
+	std::tuple<Components...> components;
+	Chooser<COMPONENTS> chooser;
+	target_predictor targets;
+	bool predictions[COMPONENTS]; // the current branch's, by component
+
+	template <class C>
+	static void componentStorage(int i, const C &c, storage_report &r) {
+		storage_report own;
+		c.storage(own);
+		for (size_t j = 0; j < own.tables.size(); j++) {
+			r.add(std::to_string(i) + ": " + own.tables[j].name, own.tables[j].bits, own.tables[j].kind);
+		}
+	}
+};
+
+#endif // ENSEMBLE_H
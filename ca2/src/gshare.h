@@ -0,0 +1,57 @@
+// gshare.h
+// This file declares gshare: a table of 2-bit counters indexed by the
+// branch address xored with the global history, folded to the index
+// width.  It only predicts directions, as a component of an ensemble (see
+// ensemble.h), and reads the global history its owner keeps.
+
+#ifndef GSHARE_H
+#define GSHARE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "storage.h"
+#include "history.h"
+
+class gshare {
+public:
+	static const uint32_t INDEX_LENGTH = 14;
+	static const uint32_t SIZE = 1 << INDEX_LENGTH;
+	static const int HISTORY_LENGTH = 16;
+
+	explicit gshare(global_history &h) : history(h) {
+		memset(counters, 2, sizeof counters);
+		fold = history.track(HISTORY_LENGTH, INDEX_LENGTH);
+	}
+
+	bool predict(uint32_t pc) {
+		index = (pc ^ history.folded(fold)) & (SIZE - 1);
+		return counters[index] >> 1;
+	}
+
+	void update(uint32_t, bool taken) {
+		uint8_t &c = counters[index];
+		if (taken && c < 0b11) {
+			c++;
+		} else if (!taken && c > 0b00) {
+			c--;
+		}
+	}
+
+	void storage(storage_report &r) const {
+		r.add("gshare", 2 * SIZE);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(counters);
+	}
+
+private:
+	uint8_t counters[SIZE]; // 2 bit counters
+	global_history &history;
+	int fold;
+	uint32_t index; // the current branch's
+};
+
+#endif // GSHARE_H
@@ -0,0 +1,267 @@
+// history.h
+// This file declares the global history that a predictor's components
+// share.  One predictor owns a global_history and pushes each branch's
+// outcome into it once; TAGE, the perceptron, gshare, the statistical
+// corrector and the target subsystem all read that one history rather than
+// each shifting a copy of their own.
+//
+// Components mostly want the history folded: its newest length outcomes
+// xored down to width bits.  Folding from scratch costs the whole length
+// on every branch, so a component asks for the folds it needs once, with
+// track(), and the history keeps each one up to date as outcomes are
+// pushed, in constant time per fold (the circular shift register folding
+// of TAGE).  The folds come out bit for bit as fold() computes them from
+// scratch, which is how TAGE has always folded: the outcomes are cut into
+// width-bit chunks, newest first, each chunk read with its newest outcome
+// as the high bit, and the chunks xored.  A fold is tracked as two shift
+// registers, one over the whole chunks and one over all length outcomes,
+// since the last, partial chunk lines up differently from the rest.
+//
+// The outcomes are kept one per byte, newest first, so &bits ()[0] is
+// always the newest; the buffer is twice the history and slides back when
+// it runs out.  The newest 256 outcomes are also kept packed in words for
+// the perceptron.
+//
+// A global_history satisfies the History interface of target.h and
+// corrector.h.
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+class global_history {
+public:
+	static const int RECENT_WORDS = 4; // the packed newest 256 outcomes
+
+	explicit global_history(int length = 0) : length(0), head(0), pushes(0) {
+		memset(recent, 0, sizeof recent);
+		reserve(length);
+	}
+
+	// keep at least length outcomes.  a component calls this, or track(),
+	// while it is built, before any outcome is pushed.
+
+	void reserve(int n) {
+		if (n <= length && !buffer.empty()) {
+			return;
+		}
+		n = std::max(n, length);
+		std::vector<uint8_t> b(2 * (n + 1), 0);
+		if (!buffer.empty()) {
+			memcpy(&b[n + 1], &buffer[head], length + 1);
+		}
+		buffer.swap(b);
+		head = n + 1;
+		length = n;
+	}
+
+	int historyLength() const {
+		return length;
+	}
+
+	// the outcomes, newest first, 1 for taken
+
+	const uint8_t *bits() const {
+		return &buffer[head];
+	}
+
+	bool operator[](int age) const {
+		return buffer[head + age];
+	}
+
+	// outcomes 64 * i to 64 * i + 63, the newest in bit 0
+
+	uint64_t word(int i) const {
+		return recent[i];
+	}
+
+	// the newest n <= 256 outcomes, xor-folded into 64 bits
+
+	uint64_t segment(int n) const {
+		uint64_t x = 0;
+		for (int i = 0; i < RECENT_WORDS && n > 0; i++, n -= 64) {
+			x ^= n >= 64 ? recent[i] : recent[i] & ((1ull << n) - 1);
+		}
+		return x;
+	}
+
+	// start keeping the newest n outcomes folded to width bits, and return
+	// the handle to read it with.  asking again for the same fold returns
+	// the same handle.
+
+	int track(int n, int width) {
+		reserve(n);
+		for (size_t i = 0; i < folds.size(); i++) {
+			if (folds[i].length == n && folds[i].width == width) {
+				return (int) i;
+			}
+		}
+		tracked f;
+		f.length = n;
+		f.width = width;
+		f.chunks = n - n % width;
+		f.shift = width - n % width;
+		f.top = 1u << (width - 1);
+		f.out = 1u << (width - 1 - n % width);
+		refold(f);
+		folds.push_back(f);
+		return (int) folds.size() - 1;
+	}
+
+	uint32_t folded(int handle) const {
+		return folds[handle].value;
+	}
+
+	// the newest min (n, historyLength ()) outcomes folded to width bits,
+	// tracked or not
+
+	uint32_t foldHistory(int n, int width) const {
+		n = std::min(n, length);
+		for (size_t i = 0; i < folds.size(); i++) {
+			if (folds[i].length == n && folds[i].width == width) {
+				return folds[i].value;
+			}
+		}
+		return fold(bits(), n, width);
+	}
+
+	// fold n outcomes from scratch
+
+	static uint32_t fold(const uint8_t *h, int n, int width) {
+		uint32_t out = 0;
+		uint32_t temp = 0;
+		for (int i = 0; i < n; i++) {
+			if (i % width == 0) {
+				out ^= temp;
+				temp = 0;
+			}
+			temp = (temp << 1) | h[i];
+		}
+		return out ^ temp;
+	}
+
+	void push(bool taken) {
+		if (head == 0) {
+			head = buffer.size() - length;
+			memmove(&buffer[head], &buffer[0], length);
+		}
+		buffer[--head] = taken;
+		pushes++;
+		for (int i = RECENT_WORDS - 1; i >= 1; i--) {
+			recent[i] = (recent[i] << 1) | (recent[i - 1] >> 63);
+		}
+		recent[0] = (recent[0] << 1) | taken;
+
+		const uint8_t *h = &buffer[head];
+		for (size_t i = 0; i < folds.size(); i++) {
+			tracked &f = folds[i];
+			uint32_t in = -(uint32_t) taken & f.top;
+			f.whole = step(f.whole, f.top, in, -(uint32_t) h[f.length] & f.out);
+			f.first = step(f.first, f.top, in, -(uint32_t) h[f.chunks] & f.top);
+			f.value = combine(f);
+		}
+	}
+
+	// the delayed update (see simulate.h) pushes each branch's predicted
+	// outcome as it is predicted, keeping checkpoint () from before the
+	// push with the branch.  restore () puts the history back to a
+	// checkpoint and pushes the true outcome instead.  The trace holds only
+	// the correct path, so a mispredicted branch is repaired before the
+	// next one is predicted and is always the newest push; putting it
+	// right only rewrites the newest outcome, in the buffer, the packed
+	// words and every fold.
+
+	uint64_t checkpoint() const {
+		return pushes;
+	}
+
+	void restore(uint64_t c, bool taken) {
+		assert(pushes == c + 1);
+		if (buffer[head] == taken) {
+			return;
+		}
+		buffer[head] = taken;
+		recent[0] ^= 1;
+		for (size_t i = 0; i < folds.size(); i++) {
+			tracked &f = folds[i];
+			if (f.length == 0) {
+				continue;
+			}
+			f.whole ^= f.top;
+			if (f.chunks) {
+				f.first ^= f.top;
+			}
+			f.value = combine(f);
+		}
+	}
+
+	// the outcomes; the folds are worked out again from them, so a
+	// history read back tracks the same folds it was built with
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.raw(&buffer[head], length);
+		io.pod(recent);
+		for (size_t i = 0; i < folds.size(); i++) {
+			refold(folds[i]);
+		}
+	}
+
+private:
+	// a tracked fold.  whole holds all length outcomes and first the
+	// whole chunks, outcome i in bit width - 1 - i % width of each; value
+	// is the fold they make.  a new outcome enters both at top, which is
+	// also where the one leaving first is; the one leaving whole is at
+	// out.  with no whole chunks first stays 0, as the outcome leaving it
+	// is the one entering.
+
+	struct tracked {
+		int length, width, chunks, shift;
+		uint32_t top, out;
+		uint32_t whole, first, value;
+	};
+
+	int length;
+	size_t head;
+	uint64_t pushes; // since the history was built
+	std::vector<uint8_t> buffer;
+	uint64_t recent[RECENT_WORDS];
+	std::vector<tracked> folds;
+
+	// one outcome in and one out: the register rotates right by one, the
+	// new outcome enters the top bit and the one now too old is cancelled
+	// where it landed.  in and out come as the bits they set, or 0, so
+	// a push is masks and xors with no branch on the outcomes.
+
+	static uint32_t step(uint32_t r, uint32_t top, uint32_t in, uint32_t out) {
+		r = (r >> 1) | (-(r & 1) & top);
+		return r ^ in ^ out;
+	}
+
+	// the partial chunk sits in the top bits of whole ^ first but belongs
+	// in the bottom ones.  with no partial chunk whole and first are the
+	// same and shift is the width, so nothing comes down.
+
+	static uint32_t combine(const tracked &f) {
+		return f.first ^ ((f.whole ^ f.first) >> f.shift);
+	}
+
+	void refold(tracked &f) const {
+		f.whole = f.first = 0;
+		for (int i = 0; i < f.length; i++) {
+			uint32_t bit = (uint32_t) buffer[head + i] << (f.width - 1 - i % f.width);
+			f.whole ^= bit;
+			if (i < f.chunks) {
+				f.first ^= bit;
+			}
+		}
+		f.value = combine(f);
+	}
+};
+
+#endif // HISTORY_H
@@ -0,0 +1,135 @@
+// local.h
+// This file declares the local history: a table of per-branch history
+// registers, each holding the last few outcomes of the branches that index
+// it.  Some branches repeat a pattern of their own that global history
+// only shows diluted by whatever else ran in between; a loop with a short
+// varying trip count, or a branch that alternates, is plain in its own
+// history.  Two things read a local_history: local_predictor, the classic
+// two-level local predictor, as a component of an ensemble (see
+// ensemble.h), and the statistical corrector's local tables (see
+// corrector.h), which a TAGE geometry asks for with local_history_length.
+//
+// The table has 2^index_length registers of length bits, newest outcome in
+// bit 0, both chosen when it is built.
+
+#ifndef LOCAL_H
+#define LOCAL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "storage.h"
+
+class local_history {
+public:
+	static const int MAX_LENGTH = 32;
+
+	explicit local_history(int index_length = 0, int length = 0)
+		: index_length(index_length), length(length), histories(length ? size_t(1) << index_length : 0, 0) {
+	}
+
+	int indexLength() const {
+		return index_length;
+	}
+
+	int historyLength() const {
+		return length;
+	}
+
+	// the history of the branches that share pc's register
+
+	uint32_t get(uint32_t pc) const {
+		return histories[index(pc)];
+	}
+
+	// the newest min (n, historyLength ()) outcomes of pc's history folded
+	// to width bits
+
+	uint32_t foldHistory(uint32_t pc, int n, int width) const {
+		if (n > length) {
+			n = length;
+		}
+		uint32_t h = n < 32 ? get(pc) & ((1u << n) - 1) : get(pc);
+		uint32_t out = 0;
+		for (; h; h >>= width) {
+			out ^= h & ((1u << width) - 1);
+		}
+		return out;
+	}
+
+	void update(uint32_t pc, bool taken) {
+		uint32_t &h = histories[index(pc)];
+		h = (h << 1) | taken;
+		if (length < 32) {
+			h &= (1u << length) - 1;
+		}
+	}
+
+	void storage(storage_report &r) const {
+		r.add("local history", (uint64_t) histories.size() * length);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.raw(histories.data(), histories.size() * sizeof(uint32_t));
+	}
+
+private:
+	int index_length;
+	int length;
+	std::vector<uint32_t> histories;
+
+	uint32_t index(uint32_t pc) const {
+		return (pc ^ (pc >> index_length)) & (histories.size() - 1);
+	}
+};
+
+// a two-level local predictor in the style of the Alpha 21264's: each
+// branch's local history selects a 3-bit counter in a pattern table shared
+// by all branches, so branches with the same recent pattern train the same
+// counter.  It only predicts directions and keeps its own local history.
+
+class local_predictor {
+public:
+	static const int INDEX_LENGTH = 10;
+	static const int HISTORY_LENGTH = 10;
+	static const int COUNTER_MAX = 7;
+
+	explicit local_predictor(int index_length = INDEX_LENGTH, int length = HISTORY_LENGTH)
+		: history(index_length, length), counters(size_t(1) << length, COUNTER_MAX / 2 + 1), index(0) {
+	}
+
+	bool predict(uint32_t pc) {
+		index = history.get(pc);
+		return counters[index] > COUNTER_MAX / 2;
+	}
+
+	void update(uint32_t pc, bool taken) {
+		uint8_t &c = counters[index];
+		if (taken && c < COUNTER_MAX) {
+			c++;
+		} else if (!taken && c > 0) {
+			c--;
+		}
+		history.update(pc, taken);
+	}
+
+	void storage(storage_report &r) const {
+		history.storage(r);
+		r.add("local patterns", (uint64_t) counters.size() * 3);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		history.serialize(io);
+		io.raw(counters.data(), counters.size());
+	}
+
+private:
+	local_history history;
+	std::vector<uint8_t> counters; // 3 bit counters
+	uint32_t index; // the current branch's
+};
+
+#endif // LOCAL_H
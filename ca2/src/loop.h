@@ -0,0 +1,158 @@
+// loop.h
+// This file declares the loop predictor, an optional side component of
+// TAGE in the style of L-TAGE.  It learns branches that behave as loops
+// with a constant trip count and, once it has seen the same count several
+// times in a row, predicts the exit exactly.  A global counter tracks
+// whether overriding TAGE with it has been paying off.
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "xorshift.h"
+
+class loop_predictor {
+public:
+	static const uint32_t SET_INDEX_LENGTH = 4;
+	static const uint32_t SETS = 1 << SET_INDEX_LENGTH;
+	static const uint32_t WAYS = 4;
+	static const uint32_t TAG_LENGTH = 14;
+	static const uint32_t ITER_LENGTH = 10;
+	static const uint32_t ITER_MASK = (1 << ITER_LENGTH) - 1;
+	static const int CONFIDENCE_MAX = 3;
+
+	// modeled bits: per entry tag, two iteration counts, confidence,
+	// age and direction; plus the 7-bit use counter
+	static const uint64_t STORAGE_BITS = (uint64_t) SETS * WAYS * (TAG_LENGTH + 2 * ITER_LENGTH + 2 + 8 + 1) + 7;
+
+	explicit loop_predictor(uint32_t seed = DEFAULT_SEED)
+		: hit(-1), valid(false), loop_pred(false), use_loop(0), rng(seed, STREAM_LOOP) {
+		memset(entries, 0, sizeof entries);
+	}
+
+	// returns the loop prediction if it is confident and has been more
+	// accurate than TAGE, otherwise tage_pred
+
+	bool predict(uint32_t pc, bool tage_pred) {
+		entry *set = entries[setOf(pc)];
+		hit = -1;
+		valid = false;
+		for (uint32_t w = 0; w < WAYS; w++) {
+			if (set[w].tag == tagOf(pc)) {
+				hit = w;
+				valid = set[w].confidence == CONFIDENCE_MAX && set[w].past;
+				loop_pred = set[w].current + 1 == set[w].past ? !set[w].dir : set[w].dir;
+				break;
+			}
+		}
+		return valid && use_loop >= 0 ? loop_pred : tage_pred;
+	}
+
+	void update(uint32_t pc, bool taken, bool tage_pred) {
+		entry *set = entries[setOf(pc)];
+
+		if (valid && loop_pred != tage_pred) {
+			if (loop_pred == taken) {
+				if (use_loop < 63) use_loop++;
+			} else if (use_loop > -64) {
+				use_loop--;
+			}
+		}
+
+		if (hit >= 0) {
+			entry &e = set[hit];
+			if (valid) {
+				if (taken != loop_pred) {
+					// the trip count changed; forget the loop
+					free(e);
+					return;
+				}
+				if (loop_pred != tage_pred && e.age < 255) e.age++;
+			}
+
+			e.current = (e.current + 1) & ITER_MASK;
+			if (e.past && e.current > e.past) {
+				// ran longer than last time
+				free(e);
+				return;
+			}
+			if (taken != e.dir) {
+				// the loop exited
+				if (e.current == e.past) {
+					if (e.confidence < CONFIDENCE_MAX) e.confidence++;
+
+					// very short loops are better left to TAGE
+					if (e.past < 3) free(e);
+				} else if (e.past == 0) {
+					e.past = e.current;
+				} else {
+					free(e);
+				}
+				e.current = 0;
+			}
+		} else if (taken != tage_pred) {
+			// TAGE missed; this may be the exit of a loop it cannot see
+			uint32_t start = rng.next() % WAYS;
+			for (uint32_t k = 0; k < WAYS; k++) {
+				entry &e = set[(start + k) % WAYS];
+				if (e.age == 0) {
+					e.tag = tagOf(pc);
+					e.dir = !taken;
+					e.past = 0;
+					e.current = 0;
+					e.confidence = 0;
+					e.age = 255;
+					return;
+				}
+			}
+			for (uint32_t w = 0; w < WAYS; w++) {
+				set[w].age--;
+			}
+		}
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(entries);
+		io.pod(use_loop);
+		rng.serialize(io);
+	}
+
+private:
+	struct entry {
+		uint16_t tag;
+		uint16_t current; // iterations so far this time
+		uint16_t past; // iterations last time, 0 = not yet known
+		uint8_t confidence;
+		uint8_t age;
+		bool dir; // direction while looping
+	};
+
+	entry entries[SETS][WAYS];
+	int hit; // way predict() found, -1 if none
+	bool valid;
+	bool loop_pred;
+	int use_loop; // 7 bit signed, >= 0 = trust the loop predictor
+	xorshift rng;
+
+	// an entry's iteration counts and confidence start over, but it keeps
+	// its tag until it ages out
+	static void free(entry &e) {
+		e.past = 0;
+		e.current = 0;
+		e.confidence = 0;
+		e.age = 0;
+	}
+
+	static uint32_t setOf(uint32_t pc) {
+		return pc & (SETS - 1);
+	}
+
+	static uint16_t tagOf(uint32_t pc) {
+		return (pc >> SET_INDEX_LENGTH) & ((1 << TAG_LENGTH) - 1);
+	}
+};
+
+#endif // LOOP_H
@@ -0,0 +1,42 @@
+// mkindex.cc
+// This file contains the trace index builder.  It decodes a trace once and
+// writes snapshots of the decoder every so many traces, so that later runs
+// can start decoding at any snapshot (see trace.cc and chunked.cc).
+//
+// Usage: mkindex [-n interval] trace index
+//	-n interval	traces between snapshots (default 1000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "trace.h"
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-n interval] trace index\n", prog);
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	long long int interval = 1000000;
+	int c;
+
+	while ((c = getopt (argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			interval = atoll (optarg);
+			if (interval <= 0 || interval > 0xffffffffLL) usage (argv[0]);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+	if (argc - optind != 2) usage (argv[0]);
+	if (!build_trace_index (argv[optind], argv[optind + 1], (uint32_t) interval)) exit (1);
+	uint32_t n;
+	uint64_t traces;
+	if (!index_info (argv[optind + 1], n, traces)) exit (1);
+	printf ("%llu traces, %llu snapshots\n", (unsigned long long) traces, (unsigned long long) (traces / n));
+	exit (0);
+}
@@ -1,284 +1,634 @@
 #ifndef MY_PREDICTOR_H
 #define MY_PREDICTOR_H
 
+#include <stdint.h>
+#include <string.h>
 #include <algorithm>
-#include <random>
+#include <type_traits>
+#include <vector>
 using namespace std;
 
-
-static const uint32_t INDEX_LENGTH = 9;
-static const uint32_t COMPONENT_SIZE = 1 << INDEX_LENGTH;
-static const uint32_t BIMODAL_INDEX_LENGTH = 12;
-static const uint32_t BIMODAL_SIZE = 1 << BIMODAL_INDEX_LENGTH;
-static const uint32_t COMPONENT_COUNT = 7;
-static const uint32_t TAG_LENGTH[COMPONENT_COUNT] = {9, 9, 10, 10, 11, 11, 12};
-static const uint32_t HISTORY_LENGTH[COMPONENT_COUNT] = {5, 9, 15, 25, 44, 76, 130};
-static const uint32_t HISTORY_BUFFER_LENGTH = 150;
-static const uint32_t USEFUL_RESET_INTERVAL = 256000;
+#include "branch.h"
+#include "predictor.h"
+#include "storage.h"
+#include "history.h"
+#include "tage_geometry.h"
+#include "simulate.h"
+#include "target.h"
+#include "loop.h"
+#include "corrector.h"
+#include "local.h"
+#include "xorshift.h"
+
+// what Tage::predict() looked up for one branch and update() trains on.
+// a branch in flight in a delayed-update pipeline keeps its own.
+
+struct tage_lookup {
+	uint32_t pc;
+	uint32_t index[MAX_COMPONENTS];
+	uint16_t tag[MAX_COMPONENTS];
+	int pred_component;
+	int altpred_component;
+	bool pred;
+	bool altpred;
+	bool outpred;
+	bool strong;
+};
 
 class my_update : public branch_update {
 public:
 	unsigned int pc;
+	tage_lookup lookup;
+	uint64_t checkpoint; // the global history's, in a delayed pipeline
 };
 
-class my_predictor : public branch_predictor {
+// storage for a TAGE table.  when the geometry is static the size N is a
+// compile-time constant and the table is a plain array; N == 0 means the
+// size is only known at run time and the table is a vector.
+
+template <class T, size_t N>
+class tage_table {
+public:
+	void assign(size_t, const T &x) {
+		fill(v, v + N, x);
+	}
+
+	size_t size() const {
+		return N;
+	}
+
+	T &operator[](size_t i) {
+		return v[i];
+	}
+
+	const T &operator[](size_t i) const {
+		return v[i];
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.raw(v, sizeof v);
+	}
+
 private:
-	class Tage {
-	public:
-		Tage() : num_branches(0), use_alt_on_na(0), strong(false), pred_component(0), altpred_component(0), pred(false),
-		         altpred(false), outpred(false) {
-			memset(bimodal, 2, sizeof bimodal);
-			memset(history, 0, sizeof history);
-		}
+	T v[N];
+};
 
-		void add_non_conditional_branch() {
-			// update history
-			for (int i = HISTORY_BUFFER_LENGTH - 1; i >= 1; i--) {
-				history[i] = history[i - 1];
-			}
-			history[0] = true;
+template <class T>
+class tage_table<T, 0> : public vector<T> {
+public:
+	template <class IO>
+	void serialize(IO &io) {
+		io.raw(this->data(), this->size() * sizeof(T));
+	}
+};
+
+// the table sizes for a geometry, or 0 for a geometry known only at run time
+
+template <class Geometry>
+struct tage_sizes {
+	static const size_t bimodal = size_t(1) << Geometry::bimodal_index_length;
+	static const size_t entries = size_t(Geometry::component_count) << Geometry::index_length;
+	static const uint32_t max_tag = max_tag_length(Geometry());
+};
+
+template <>
+struct tage_sizes<tage_geometry> {
+	static const size_t bimodal = 0;
+	static const size_t entries = 0;
+	static const uint32_t max_tag = 16;
+};
+
+// tags are stored in the narrowest type that holds the longest tag
+
+template <class Geometry>
+struct tage_tag {
+	typedef typename conditional<tage_sizes<Geometry>::max_tag <= 8, uint8_t, uint16_t>::type type;
+};
+
+// Tage is templated on its geometry (see tage_geometry.h).  With a static
+// geometry every size below is a compile-time constant; with tage_geometry
+// the same code reads the sizes from g at run time.
+//
+// The tables are laid out for the access pattern rather than as an array of
+// entry structs.  Each component's tags are a separate dense array, so the
+// tags one branch needs are read with one load per component and all
+// compared, without a branch.  The prediction and useful counters of an
+// entry share one byte, and the bimodal table packs four 2-bit counters
+// per byte.  A branch's indices and tags are computed once in predict()
+// and reused by update(), since the history does not change in between.
+//
+// The global history is the owner's (see history.h), which pushes every
+// branch's outcome into it after update(); Tage tracks the folds of it
+// that its indices and tags use.
+
+template <class Geometry>
+class Tage {
+public:
+	typedef typename tage_tag<Geometry>::type tag_t;
+
+	explicit Tage(global_history &h, uint32_t seed = DEFAULT_SEED, const Geometry &geometry = Geometry())
+		: g(geometry), history(h), rng(seed, STREAM_TAGE), num_branches(0), use_alt_on_na(0), strong(false), pred_component(0), altpred_component(0),
+		  last_allocated(0), last_evicted(false), last_pc(0), pred(false), altpred(false), outpred(false) {
+		bimodal.assign(size_t(1) << (g.bimodal_index_length - 2), 0b10101010);
+		tags.assign(size_t(g.component_count) << g.index_length, 0);
+		counters.assign(size_t(g.component_count) << g.index_length, weakTaken());
+		history.reserve(max_history_length(g));
+		for (uint32_t i = 0; i < g.component_count; i++) {
+			index_fold[i] = history.track(g.history_length[i], g.index_length);
+			tag_fold[i] = history.track(g.history_length[i], g.tag_length[i]);
 		}
+	}
+
+	const Geometry &geometry() const {
+		return g;
+	}
 
-		bool predict(uint32_t pc) {
-			pred_component = bestMatchingComponent(pc, COMPONENT_COUNT + 1);
-			altpred_component = bestMatchingComponent(pc, pred_component);
+	bool predict(uint32_t pc) {
+		last_pc = pc;
+		computeIndices(pc);
 
-			pred = predictComponent(pc, pred_component);
-			altpred = predictComponent(pc, altpred_component);
+		uint32_t matches = matchingComponents();
+		pred_component = matches ? 32 - __builtin_clz(matches) : 0;
+		matches &= ~(1u << pred_component >> 1);
+		altpred_component = matches ? 32 - __builtin_clz(matches) : 0;
 
-			if (pred_component == 0) {
+		pred = predictComponent(pc, pred_component);
+		altpred = predictComponent(pc, altpred_component);
+
+		if (pred_component == 0) {
+			outpred = pred;
+		} else {
+			int pred_pred = getCounter(pred_component);
+			strong = !(pred_pred == weakTaken() || pred_pred == weakTaken() - 1);
+			if (use_alt_on_na < 8 || strong) {
 				outpred = pred;
 			} else {
-				int pred_pred = predictors[pred_component - 1][getComponentIndex(pc, pred_component)].pred;
-				strong = !(pred_pred == 0b100 || pred_pred == 0b011);
-				if (use_alt_on_na < 8 || strong) {
-					outpred = pred;
-				} else {
-					outpred = altpred;
-				}
+				outpred = altpred;
 			}
+		}
+
+		return outpred;
+	}
+
+	// how far from weak the counter behind the last prediction is; 0 means
+	// the counter was weak
 
-			return outpred;
+	int confidence() const {
+		int component = provider();
+		if (component == 0) {
+			int ctr = getBimodal(getBimodalIndex(last_pc));
+			return ctr == 0b00 || ctr == 0b11;
 		}
+		int ctr = getCounter(component);
+		return abs(2 * ctr + 1 - (1 << g.counter_bits)) >> 1;
+	}
 
-		void update(uint32_t pc, bool taken) {
-			if (pred_component > 0) {
-				updatePredictor(pc, taken);
-			} else {
-				updateBimodal(pc, taken);
-			}
+	// the component whose prediction predict() returned; 0 is the bimodal
+
+	int provider() const {
+		return outpred == pred ? pred_component : altpred_component;
+	}
 
-			// attempt to allocate if prediction is incorrect
-			if (outpred != taken && pred_component != COMPONENT_COUNT) {
-				const int start = pred_component + 1;
+	// the component the last update() allocated in, or 0 if none, and
+	// whether the entry it replaced had been trained since it was reset
 
-				can_allocate.clear();
-				for (int i = start; i <= COMPONENT_COUNT; i++) {
-					PredictorEntry *e = &predictors[i - 1][getComponentIndex(pc, i)];
-					if (e->useful == 0) {
-						can_allocate.push_back(i);
-					}
-				}
+	int allocated() const {
+		return last_allocated;
+	}
+
+	bool evicted() const {
+		return last_evicted;
+	}
+
+	// train the tables on the last prediction; the owner pushes the
+	// outcome into the history afterwards
+
+	void update(uint32_t pc, bool taken) {
+		train(pc, taken);
+	}
+
+	// the delayed update (see simulate.h): the owner pushes the outcome
+	// into the history as soon as the branch is predicted, and retire()
+	// trains the tables later from what lookup() kept of the prediction.
+	// retire() leaves l as the current lookup.
+
+	tage_lookup lookup() const {
+		tage_lookup l;
+		l.pc = last_pc;
+		memcpy(l.index, computed_index, sizeof l.index);
+		memcpy(l.tag, computed_tag, sizeof l.tag);
+		l.pred_component = pred_component;
+		l.altpred_component = altpred_component;
+		l.pred = pred;
+		l.altpred = altpred;
+		l.outpred = outpred;
+		l.strong = strong;
+		return l;
+	}
+
+	void retire(const tage_lookup &l, bool taken) {
+		last_pc = l.pc;
+		memcpy(computed_index, l.index, sizeof computed_index);
+		memcpy(computed_tag, l.tag, sizeof computed_tag);
+		pred_component = l.pred_component;
+		altpred_component = l.altpred_component;
+		pred = l.pred;
+		altpred = l.altpred;
+		outpred = l.outpred;
+		strong = l.strong;
+		train(l.pc, taken);
+	}
+
+	// a pipeline repairs the history on a misprediction from a pointer
+	// into a circular buffer of twice the history, checkpointed per branch
+
+	int checkpointBits() const {
+		return 32 - __builtin_clz(2 * max(history.historyLength(), 1) - 1);
+	}
 
-				if (can_allocate.size() == 0) {
-					for (int i = start; i <= COMPONENT_COUNT; i++) {
-						predictors[i - 1][getComponentIndex(pc, i)].useful--;
-					}
-				} else {
-					int i = 0;
-					while (random() & 1) {
-						i++;
-					}
-
-					int component = can_allocate[i % can_allocate.size()];
-					PredictorEntry *e = &predictors[component - 1][getComponentIndex(pc, component)];
-					e->pred = 0b100;
-					e->tag = getComponentTag(pc, component);
+	void storage(storage_report &r) const {
+		tage_storage(describe_geometry(g), r);
+	}
+
+	// everything but the geometry, which the owner must already match,
+	// and the history, which the owner keeps
+
+	template <class IO>
+	void serialize(IO &io) {
+		bimodal.serialize(io);
+		tags.serialize(io);
+		counters.serialize(io);
+		io.pod(num_branches);
+		io.pod(use_alt_on_na);
+		rng.serialize(io);
+	}
+
+private:
+	const Geometry g;
+	global_history &history;
+	xorshift rng; // picks among allocation candidates
+	tage_table<uint8_t, tage_sizes<Geometry>::bimodal / 4> bimodal; // four 2 bit bimodal counters per byte
+	tage_table<tag_t, tage_sizes<Geometry>::entries> tags; // component_count tables of 1 << index_length tags
+	tage_table<uint8_t, tage_sizes<Geometry>::entries> counters; // useful above counter_bits of prediction
+	uint32_t num_branches;
+	int use_alt_on_na; // 4 bits, <8 = don't use alt on new alloc; >=8 = use alt on new alloc
+	bool strong;
+	vector<int> can_allocate;
+
+	// each component's folds of the history, for its index and its tag
+	int index_fold[MAX_COMPONENTS];
+	int tag_fold[MAX_COMPONENTS];
+
+	// the current branch's index and tag in each component
+	uint32_t computed_index[MAX_COMPONENTS];
+	uint16_t computed_tag[MAX_COMPONENTS];
+
+	int pred_component;
+	int altpred_component;
+	int last_allocated;
+	bool last_evicted;
+	uint32_t last_pc;
+	bool pred;
+	bool altpred;
+	bool outpred;
+
+	// train the tables on the current lookup
+
+	void train(uint32_t pc, bool taken) {
+		last_allocated = 0;
+		last_evicted = false;
+		if (pred_component > 0) {
+			updatePredictor(pc, taken);
+		} else {
+			updateBimodal(pc, taken);
+		}
+
+		// attempt to allocate if prediction is incorrect
+		if (outpred != taken && pred_component != (int) g.component_count) {
+			const int start = pred_component + 1;
+
+			can_allocate.clear();
+			for (int i = start; i <= (int) g.component_count; i++) {
+				if (getUseful(i) == 0) {
+					can_allocate.push_back(i);
 				}
 			}
 
-			// update history
-			for (int i = HISTORY_BUFFER_LENGTH - 1; i >= 1; i--) {
-				history[i] = history[i - 1];
-			}
-			history[0] = taken;
-
-			// reset useful counters
-			num_branches++;
-			if (num_branches == USEFUL_RESET_INTERVAL) {
-				num_branches = 0;
-				for (int i = 0; i < COMPONENT_COUNT; i++) {
-					for (int j = 0; j < COMPONENT_SIZE; j++) {
-						predictors[i][j].useful >>= 1;
-					}
+			if (can_allocate.size() == 0) {
+				for (int i = start; i <= (int) g.component_count; i++) {
+					setUseful(i, getUseful(i) - 1);
 				}
+			} else {
+				int component = can_allocate[rng.geometric() % can_allocate.size()];
+				last_allocated = component;
+				last_evicted = tags[slot(component)] != 0 || getCounter(component) != weakTaken();
+				setCounter(component, weakTaken());
+				tags[slot(component)] = computed_tag[component - 1];
 			}
 		}
 
-	private:
-		struct PredictorEntry {
-			PredictorEntry() {
-				pred = 0b100;
-				tag = 0;
-				useful = 0;
+		// reset useful counters
+		num_branches++;
+		if (num_branches == g.useful_reset_interval) {
+			num_branches = 0;
+			const uint8_t ctr_mask = counterMax();
+			for (size_t i = 0; i < counters.size(); i++) {
+				uint8_t useful = counters[i] >> g.counter_bits;
+				counters[i] = (counters[i] & ctr_mask) | ((useful >> 1) << g.counter_bits);
 			}
-
-			uint8_t pred; // 3 bit prediction (>100: yes, <= 011: no)
-			uint16_t tag;
-			uint8_t useful; // 2 bit useful
-		};
-
-		uint8_t bimodal[BIMODAL_SIZE]; // holds 2 bit bimodal
-		PredictorEntry predictors[COMPONENT_COUNT][COMPONENT_SIZE];
-		bool history[HISTORY_BUFFER_LENGTH];
-		int num_branches;
-		int use_alt_on_na; // 4 bits, <8 = don't use alt on new alloc; >=8 = use alt on new alloc
-		bool strong;
-		vector<int> can_allocate;
-
-		int pred_component;
-		int altpred_component;
-		bool pred;
-		bool altpred;
-		bool outpred;
-
-		static uint16_t getBimodalIndex(const uint32_t pc) {
-			return pc & ((1 << BIMODAL_INDEX_LENGTH) - 1);
 		}
+	}
 
-		bool predictBimodal(const uint32_t pc) const {
-			return bimodal[getBimodalIndex(pc)] >> 1;
-		}
+	int weakTaken() const {
+		return 1 << (g.counter_bits - 1);
+	}
 
-		void updateBimodal(const uint32_t pc, bool taken) {
-			// update bimodal predictor
-			uint16_t index = getBimodalIndex(pc);
-			if (taken && bimodal[index] < 0b11) {
-				bimodal[index]++;
-			} else if (!taken && bimodal[index] > 0b00) {
-				bimodal[index]--;
-			}
+	int counterMax() const {
+		return (1 << g.counter_bits) - 1;
+	}
+
+	int usefulMax() const {
+		return (1 << g.useful_bits) - 1;
+	}
+
+	size_t slot(int component) const {
+		return ((size_t) (component - 1) << g.index_length) + computed_index[component - 1];
+	}
+
+	int getCounter(int component) const {
+		return counters[slot(component)] & counterMax();
+	}
+
+	void setCounter(int component, int ctr) {
+		uint8_t &c = counters[slot(component)];
+		c = (c & ~counterMax()) | ctr;
+	}
+
+	int getUseful(int component) const {
+		return counters[slot(component)] >> g.counter_bits;
+	}
+
+	void setUseful(int component, int useful) {
+		uint8_t &c = counters[slot(component)];
+		c = (c & counterMax()) | (useful << g.counter_bits);
+	}
+
+	uint32_t getBimodalIndex(const uint32_t pc) const {
+		return pc & ((1 << g.bimodal_index_length) - 1);
+	}
+
+	int getBimodal(uint32_t index) const {
+		return (bimodal[index >> 2] >> ((index & 3) * 2)) & 0b11;
+	}
+
+	bool predictBimodal(const uint32_t pc) const {
+		return getBimodal(getBimodalIndex(pc)) >> 1;
+	}
+
+	void updateBimodal(const uint32_t pc, bool taken) {
+		// update bimodal predictor
+		uint32_t index = getBimodalIndex(pc);
+		int ctr = getBimodal(index);
+		if (taken && ctr < 0b11) {
+			ctr++;
+		} else if (!taken && ctr > 0b00) {
+			ctr--;
 		}
+		int shift = (index & 3) * 2;
+		bimodal[index >> 2] = (bimodal[index >> 2] & ~(0b11 << shift)) | (ctr << shift);
+	}
 
-		bool predictComponent(uint32_t pc, int component) const {
-			if (component > 0) {
-				return predictors[component - 1][getComponentIndex(pc, component)].pred >> 2;
-			} else {
-				return predictBimodal(pc);
-			}
+	bool predictComponent(uint32_t pc, int component) const {
+		if (component > 0) {
+			return getCounter(component) >> (g.counter_bits - 1);
+		} else {
+			return predictBimodal(pc);
 		}
+	}
 
-		uint32_t compressHistory(const int from, const int to) const {
-			uint32_t out = 0;
-			uint32_t temp = 0;
+	uint32_t getComponentIndex(uint32_t pc, int component) const {
+		uint32_t compressed_history = history.folded(index_fold[component - 1]);
+		return (compressed_history ^ pc ^ (pc >> ((g.index_length - component) + 1))) & ((1 << g.index_length) - 1);
+	}
 
-			for (int i = 0; i < from; i++) {
-				if (i % to == 0) {
-					out ^= temp;
-					temp = 0;
-				}
-				temp = (temp << 1) | history[i];
-			}
-			out ^= temp;
-			return out;
+	uint16_t getComponentTag(uint32_t pc, int component) const {
+		uint32_t compressed_history = history.folded(tag_fold[component - 1]);
+		return (compressed_history ^ pc) & ((1 << g.tag_length[component - 1]) - 1);
+	}
+
+	// compute this branch's index and tag in every component and start
+	// fetching the lines they live in
+
+	void computeIndices(uint32_t pc) {
+		for (int i = 1; i <= (int) g.component_count; i++) {
+			computed_index[i - 1] = getComponentIndex(pc, i);
+			computed_tag[i - 1] = getComponentTag(pc, i);
+			__builtin_prefetch(&tags[slot(i)]);
+			__builtin_prefetch(&counters[slot(i)]);
 		}
+	}
 
-		uint16_t getComponentIndex(uint32_t pc, int component) const {
-			uint32_t compressed_history = compressHistory(HISTORY_LENGTH[component - 1], INDEX_LENGTH);
-			return (compressed_history ^ pc ^ (pc >> (INDEX_LENGTH - component) + 1)) & ((1 << INDEX_LENGTH) - 1);
+	// bit i - 1 of the result is set when component i's tag matches.
+	// every component is compared, with no branch on which matched; a
+	// compare per component is quicker than gathering the tags into a
+	// vector register, whose load would wait on the stores building it.
+
+	uint32_t matchingComponents() const {
+		uint32_t matches = 0;
+		for (uint32_t i = 0; i < g.component_count; i++) {
+			matches |= (uint32_t) (tags[((size_t) i << g.index_length) + computed_index[i]] == computed_tag[i]) << i;
 		}
+		return matches;
+	}
 
-		uint16_t getComponentTag(uint32_t pc, int component) const {
-			uint32_t compressed_history = compressHistory(HISTORY_LENGTH[component - 1], TAG_LENGTH[component - 1]);
-			return (compressed_history ^ pc) & ((1 << TAG_LENGTH[component - 1]) - 1);
+	void updateCounter(int component, bool taken) {
+		int ctr = getCounter(component);
+		if (taken && ctr < counterMax()) {
+			setCounter(component, ctr + 1);
+		} else if (!taken && ctr > 0) {
+			setCounter(component, ctr - 1);
 		}
+	}
 
-		bool tagMatchesComponent(uint32_t pc, int component) const {
-			return predictors[component - 1][getComponentIndex(pc, component)].tag == getComponentTag(pc, component);
+	void updatePredictor(uint32_t pc, bool taken) {
+		// update use_alt_on_na 4 bit counter
+		if (!strong && pred != altpred) {
+			if (use_alt_on_na < 16 && pred != taken) {
+				use_alt_on_na++;
+			} else if (use_alt_on_na > 0 && pred == taken) {
+				use_alt_on_na--;
+			}
 		}
 
-		int bestMatchingComponent(uint32_t pc, int highest_allowable_component) const {
-			for (int i = highest_allowable_component - 1; i >= 1; i--) {
-				if (tagMatchesComponent(pc, i)) {
-					return i;
-				}
+		// update alternate if current not useful
+		if (getUseful(pred_component) == 0) {
+			if (altpred_component == 0) {
+				updateBimodal(pc, taken);
+			} else {
+				updateCounter(altpred_component, taken);
 			}
-			return 0;
 		}
 
-		void updatePredictor(uint32_t pc, bool taken) {
-			// update use_alt_on_na 4 bit counter
-			if (!strong && pred != altpred) {
-				if (use_alt_on_na < 16 && pred != taken) {
-					use_alt_on_na++;
-				} else if (use_alt_on_na > 0 && pred == taken) {
-					use_alt_on_na--;
-				}
+		// update current counter
+		updateCounter(pred_component, taken);
+
+		// update useful if alternate differs in prediction
+		if (pred != altpred) {
+			int useful = getUseful(pred_component);
+			if (pred == taken && useful < usefulMax()) {
+				setUseful(pred_component, useful + 1);
+			} else if (pred != taken && useful > 0b00) {
+				setUseful(pred_component, useful - 1);
 			}
+		}
+	}
+};
 
+// tage_predictor has the static predictor interface (see simulate.h).
+// TAGE predicts directions; the target subsystem, sharing TAGE's global
+// history, predicts targets.  If the geometry asks for them, the
+// statistical corrector may overturn TAGE's direction, and the loop
+// predictor may overturn that in turn.  A geometry with a local history
+// keeps one here, for the corrector's local tables (see local.h).
 
-			PredictorEntry *e = &predictors[pred_component - 1][getComponentIndex(pc, pred_component)];
+template <class Geometry>
+class tage_predictor {
+private:
+	global_history history;
+	Tage<Geometry> tage;
+	target_predictor targets;
+	loop_predictor loop;
+	statistical_corrector corrector;
+	local_history local;
+	bool tage_pred;
+	bool sc_pred;
 
-			// update alternate if current not useful
-			if (e->useful == 0) {
-				if (altpred_component == 0) {
-					updateBimodal(pc, taken);
-				} else {
-					PredictorEntry *alte = &predictors[altpred_component - 1][getComponentIndex(pc, altpred_component)];
-					if (taken && alte->pred < 0b111) {
-						alte->pred++;
-					} else if (!taken && alte->pred > 0b000) {
-						alte->pred--;
-					}
-				}
-			}
+public:
+	typedef my_update update_type;
+
+	explicit tage_predictor(const Geometry &g = Geometry(), uint32_t seed = DEFAULT_SEED)
+		: tage(history, seed, g), targets(seed), loop(seed),
+		  local(g.local_history_index_length, g.local_history_length), tage_pred(false), sc_pred(false) {
+		targets.track(history);
+		if (g.statistical_corrector) {
+			corrector.track(history);
+		}
+	}
 
-			// update current counter
-			if (taken && e->pred < 0b111) {
-				e->pred++;
-			} else if (!taken && e->pred > 0b000) {
-				e->pred--;
+	void predict(const branch_info &b, my_update &u) {
+		if (b.br_flags & BR_CONDITIONAL) {
+			const Geometry &g = tage.geometry();
+			tage_pred = tage.predict(b.address);
+			sc_pred = tage_pred;
+			if (g.statistical_corrector) {
+				sc_pred = corrector.predict(b.address, tage_pred, tage.confidence(), history,
+				                            g.local_history_length ? &local : NULL);
 			}
-
-			// update useful if alternate differs in prediction
-			if (pred != altpred) {
-				if (pred == taken && e->useful < 0b11) {
-					e->useful++;
-				} else if (pred != taken && e->useful > 0b00) {
-					e->useful--;
-				}
+			bool pred = sc_pred;
+			if (g.loop_predictor) {
+				pred = loop.predict(b.address, sc_pred);
 			}
+			u.direction_prediction(pred);
+			u.provider(tage.provider());
+		} else {
+			u.direction_prediction(true);
 		}
-	};
+		u.target_prediction(targets.predict(b, history));
+		u.pc = b.address;
+	}
 
-	Tage tage;
+	void update(const branch_info &b, my_update &u, bool taken, unsigned int target) {
+		targets.update(b, taken, target);
+		if (b.br_flags & BR_CONDITIONAL) {
+			const Geometry &g = tage.geometry();
+			if (g.statistical_corrector) {
+				corrector.update(taken);
+			}
+			if (g.local_history_length) {
+				local.update(u.pc, taken);
+			}
+			if (g.loop_predictor) {
+				loop.update(u.pc, taken, sc_pred);
+			}
+			tage.update(u.pc, taken);
+			u.allocated(tage.allocated(), tage.evicted());
+		}
+		history.push(!(b.br_flags & BR_CONDITIONAL) || taken);
+	}
 
-public:
-	my_update u;
-	branch_info bi;
+	// the delayed update (see simulate.h).  speculate() pushes the
+	// predicted direction into the global history as the branch is
+	// fetched, keeping the history's checkpoint in u, and resolve()
+	// restores the history from it if the direction was wrong.  the
+	// target subsystem, loop predictor, corrector and local history keep
+	// their single in-flight lookup and are brought up to date at
+	// resolve(), as if their own histories and counts were speculative;
+	// only TAGE's tables are trained late.
+
+	void speculate(const branch_info &b, my_update &u) {
+		u.checkpoint = history.checkpoint();
+		history.push(!(b.br_flags & BR_CONDITIONAL) || u.direction_prediction());
+	}
 
-	my_predictor(void) : u(), bi() {
+	void resolve(const branch_info &b, my_update &u, bool taken, unsigned int target) {
+		targets.update(b, taken, target);
+		if (b.br_flags & BR_CONDITIONAL) {
+			const Geometry &g = tage.geometry();
+			if (g.statistical_corrector) {
+				corrector.update(taken);
+			}
+			if (g.local_history_length) {
+				local.update(u.pc, taken);
+			}
+			if (g.loop_predictor) {
+				loop.update(u.pc, taken, sc_pred);
+			}
+			u.lookup = tage.lookup();
+			if (u.direction_prediction() != taken) {
+				history.restore(u.checkpoint, taken);
+			}
+		}
 	}
 
-	branch_update *predict(branch_info &b) {
-		bi = b;
+	void retire(const branch_info &b, my_update &u, bool taken, unsigned int) {
 		if (b.br_flags & BR_CONDITIONAL) {
-			u.direction_prediction(tage.predict(b.address));
-		} else {
-			u.direction_prediction(true);
+			tage.retire(u.lookup, taken);
+			u.allocated(tage.allocated(), tage.evicted());
 		}
-		u.target_prediction(0);
-		u.pc = b.address;
-		return &u;
 	}
 
-	void update(branch_update *u, bool taken, unsigned int target) {
-		if (bi.br_flags & BR_CONDITIONAL) {
-			tage.update(static_cast<my_update *>(u)->pc, taken);
-		} else {
-			tage.add_non_conditional_branch();
+	void storage(storage_report &r) const {
+		geometry_storage(describe_geometry(tage.geometry()), r);
+	}
+
+	// the global history pointer, and the indirect predictor's path
+	// history and the return stack's top, which are speculative too
+
+	int checkpoint_bits() const {
+		return tage.checkpointBits() + 32 + 5;
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		const Geometry &g = tage.geometry();
+		tage.serialize(io);
+		history.serialize(io);
+		targets.serialize(io);
+		if (g.loop_predictor) {
+			loop.serialize(io);
+		}
+		if (g.statistical_corrector) {
+			corrector.serialize(io, g.local_history_length != 0);
+		}
+		if (g.local_history_length) {
+			local.serialize(io);
 		}
 	}
 };
 
+// the predictor the contest driver has always built
+
+typedef predictor_adapter<tage_predictor<geometry_default> > my_predictor;
+
 #endif // MY_PREDICTOR_H
@@ -0,0 +1,308 @@
+// perceptron.h
+// This file declares the hashed perceptron predictor, an alternative to
+// TAGE.  Its output is the sum of int8 weights from three sources:
+//
+// - a row of GLOBAL_WEIGHTS weights selected by the branch address, dotted
+//   with the last GLOBAL_WEIGHTS global outcomes as +1/-1 (the classic
+//   perceptron);
+// - HASHED_TABLES tables each indexed by a hash of the address and a
+//   different length of global history, the first with no history at all
+//   so it acts as the bias weight;
+// - LOCAL_TABLES tables indexed by a hash of the address and that branch's
+//   own recent outcomes.
+//
+// A branch is predicted taken when the sum is non-negative, and trained
+// when it was mispredicted or the sum was within the threshold of zero.
+// The threshold adapts as in O-GEHL.  The row dot product and its training
+// update run on 32 weights at a time with AVX2 when the CPU has it, and
+// with an equivalent scalar loop otherwise.
+//
+// perceptron is the direction predictor alone, reading a global history
+// its owner keeps (see history.h), so it can sit in an ensemble (see
+// ensemble.h).  perceptron_predictor owns the history and adds targets
+// from the same target subsystem as TAGE, folding the history its own way.
+
+#ifndef PERCEPTRON_H
+#define PERCEPTRON_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "branch.h"
+#include "predictor.h"
+#include "storage.h"
+#include "history.h"
+#include "target.h"
+
+// the row dot product and training update, 32 weights at a time
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+inline int perceptron_dot_avx2(const int8_t *w, const int8_t *x, int n) {
+	__m256i sum = _mm256_setzero_si256();
+	const __m256i ones8 = _mm256_set1_epi8(1);
+	const __m256i ones16 = _mm256_set1_epi16(1);
+	for (int i = 0; i < n; i += 32) {
+		__m256i v = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *) (w + i)),
+		                             _mm256_loadu_si256((const __m256i *) (x + i)));
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, v), ones16));
+	}
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+inline void perceptron_train_avx2(int8_t *w, const int8_t *x, int n, bool taken) {
+	const __m256i floor = _mm256_set1_epi8(-127);
+	const __m256i direction = _mm256_set1_epi8(taken ? 1 : -1);
+	for (int i = 0; i < n; i += 32) {
+		__m256i step = _mm256_sign_epi8(direction, _mm256_loadu_si256((const __m256i *) (x + i)));
+		__m256i v = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i *) (w + i)), step);
+		_mm256_storeu_si256((__m256i *) (w + i), _mm256_max_epi8(v, floor));
+	}
+}
+#endif
+
+inline int perceptron_dot_scalar(const int8_t *w, const int8_t *x, int n) {
+	int sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += w[i] * x[i];
+	}
+	return sum;
+}
+
+inline void perceptron_train_scalar(int8_t *w, const int8_t *x, int n, bool taken) {
+	for (int i = 0; i < n; i++) {
+		int v = w[i] + (taken ? x[i] : -x[i]);
+		w[i] = v > 127 ? 127 : v < -127 ? -127 : v;
+	}
+}
+
+class perceptron {
+public:
+	static const int GLOBAL_WEIGHTS = 64; // a multiple of 32
+	static const uint32_t ROW_INDEX_LENGTH = 8;
+	static const uint32_t ROWS = 1 << ROW_INDEX_LENGTH;
+	static const int HASHED_TABLES = 8;
+	static const int LOCAL_TABLES = 2;
+	static const uint32_t TABLE_INDEX_LENGTH = 10;
+	static const uint32_t TABLE_SIZE = 1 << TABLE_INDEX_LENGTH;
+	static const uint32_t LOCAL_HISTORY_INDEX_LENGTH = 10;
+	static const uint32_t LOCAL_HISTORY_SIZE = 1 << LOCAL_HISTORY_INDEX_LENGTH;
+	static const int HISTORY_LENGTH = 256; // of global history
+
+	// modeled bits, besides the weight tables: the 8-bit threshold and
+	// 7-bit threshold counter
+	static const uint64_t THRESHOLD_BITS = 8 + 7;
+
+	explicit perceptron(global_history &h) : history(h), sum(0), threshold(GLOBAL_WEIGHTS + 14), threshold_counter(0) {
+		memset(rows, 0, sizeof rows);
+		memset(hashed, 0, sizeof hashed);
+		memset(local, 0, sizeof local);
+		memset(local_history, 0, sizeof local_history);
+		history.reserve(HISTORY_LENGTH);
+#ifdef __x86_64__
+		use_avx2 = __builtin_cpu_supports("avx2");
+#else
+		use_avx2 = false;
+#endif
+	}
+
+	bool predict(uint32_t pc) {
+		computeIndices(pc);
+		const uint8_t *h = history.bits();
+		for (int i = 0; i < GLOBAL_WEIGHTS; i++) {
+			signs[i] = 2 * h[i] - 1;
+		}
+		sum = dot(rows[row], signs);
+		for (int i = 0; i < HASHED_TABLES; i++) {
+			sum += hashed[i][hashed_index[i]];
+		}
+		for (int i = 0; i < LOCAL_TABLES; i++) {
+			sum += local[i][local_index[i]];
+		}
+		return sum >= 0;
+	}
+
+	// train on the last prediction; the owner pushes the outcome into the
+	// global history afterwards
+
+	void update(uint32_t pc, bool taken) {
+		bool pred = sum >= 0;
+		if (pred != taken || abs(sum) <= threshold) {
+			train(rows[row], signs, taken);
+			for (int i = 0; i < HASHED_TABLES; i++) {
+				trainWeight(hashed[i][hashed_index[i]], taken);
+			}
+			for (int i = 0; i < LOCAL_TABLES; i++) {
+				trainWeight(local[i][local_index[i]], taken);
+			}
+			adaptThreshold(pred != taken);
+		}
+		uint16_t &h = local_history[pc & (LOCAL_HISTORY_SIZE - 1)];
+		h = (h << 1) | taken;
+	}
+
+	void storage(storage_report &r) const {
+		r.add("weight rows", (uint64_t) ROWS * GLOBAL_WEIGHTS * 8);
+		r.add("hashed weights", (uint64_t) HASHED_TABLES * TABLE_SIZE * 8);
+		r.add("local weights", (uint64_t) LOCAL_TABLES * TABLE_SIZE * 8);
+		r.add("local histories", (uint64_t) LOCAL_HISTORY_SIZE * 16);
+		r.add("threshold", THRESHOLD_BITS, STORAGE_REGISTER);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(rows);
+		io.pod(hashed);
+		io.pod(local);
+		io.pod(local_history);
+		io.pod(threshold);
+		io.pod(threshold_counter);
+	}
+
+private:
+	static constexpr int HASHED_HISTORY_LENGTH[HASHED_TABLES] = {0, 3, 6, 12, 24, 48, 96, 192};
+	static constexpr int LOCAL_HISTORY_LENGTH[LOCAL_TABLES] = {6, 16};
+
+	alignas(32) int8_t rows[ROWS][GLOBAL_WEIGHTS];
+	int8_t hashed[HASHED_TABLES][TABLE_SIZE];
+	int8_t local[LOCAL_TABLES][TABLE_SIZE];
+	uint16_t local_history[LOCAL_HISTORY_SIZE];
+	global_history &history;
+	alignas(32) int8_t signs[GLOBAL_WEIGHTS]; // the newest outcomes as +1/-1
+	bool use_avx2;
+
+	// the current branch's row and table indices
+	uint32_t row;
+	uint32_t hashed_index[HASHED_TABLES];
+	uint32_t local_index[LOCAL_TABLES];
+
+	int sum;
+	int threshold;
+	int threshold_counter;
+
+	int dot(const int8_t *w, const int8_t *x) const {
+#ifdef __x86_64__
+		if (use_avx2) {
+			return perceptron_dot_avx2(w, x, GLOBAL_WEIGHTS);
+		}
+#endif
+		return perceptron_dot_scalar(w, x, GLOBAL_WEIGHTS);
+	}
+
+	void train(int8_t *w, const int8_t *x, bool taken) {
+#ifdef __x86_64__
+		if (use_avx2) {
+			perceptron_train_avx2(w, x, GLOBAL_WEIGHTS, taken);
+			return;
+		}
+#endif
+		perceptron_train_scalar(w, x, GLOBAL_WEIGHTS, taken);
+	}
+
+	static void trainWeight(int8_t &w, bool taken) {
+		if (taken && w < 127) {
+			w++;
+		} else if (!taken && w > -127) {
+			w--;
+		}
+	}
+
+	static uint32_t hash(uint64_t x, uint32_t pc, int salt) {
+		x ^= ((uint64_t) pc << 32) ^ pc ^ ((uint64_t) salt << 58);
+		x *= 0x9e3779b97f4a7c15ull;
+		return (uint32_t) (x >> (64 - TABLE_INDEX_LENGTH));
+	}
+
+	void computeIndices(uint32_t pc) {
+		row = (pc ^ (pc >> ROW_INDEX_LENGTH)) & (ROWS - 1);
+		for (int i = 0; i < HASHED_TABLES; i++) {
+			hashed_index[i] = hash(history.segment(HASHED_HISTORY_LENGTH[i]), pc, i);
+		}
+		uint16_t h = local_history[pc & (LOCAL_HISTORY_SIZE - 1)];
+		for (int i = 0; i < LOCAL_TABLES; i++) {
+			uint64_t bits = LOCAL_HISTORY_LENGTH[i] >= 16 ? h : h & ((1u << LOCAL_HISTORY_LENGTH[i]) - 1);
+			local_index[i] = hash(bits, pc, HASHED_TABLES + i);
+		}
+	}
+
+	// raise the threshold when training is mostly on mispredictions and
+	// lower it when mostly on correct but low-confidence predictions
+
+	void adaptThreshold(bool mispredicted) {
+		if (mispredicted) {
+			if (++threshold_counter >= 63) {
+				threshold_counter = 0;
+				threshold++;
+			}
+		} else if (--threshold_counter <= -63) {
+			threshold_counter = 0;
+			if (threshold > 0) threshold--;
+		}
+	}
+};
+
+class perceptron_predictor {
+public:
+	typedef branch_update update_type;
+
+	explicit perceptron_predictor(uint32_t seed = DEFAULT_SEED) : direction(history), targets(seed) {
+	}
+
+	void predict(const branch_info &b, update_type &u) {
+		if (b.br_flags & BR_CONDITIONAL) {
+			u.direction_prediction(direction.predict(b.address));
+			u.provider(0);
+		} else {
+			u.direction_prediction(true);
+		}
+		u.target_prediction(targets.predict(b, *this));
+	}
+
+	void update(const branch_info &b, update_type &, bool taken, unsigned int target) {
+		targets.update(b, taken, target);
+		if (b.br_flags & BR_CONDITIONAL) {
+			direction.update(b.address, taken);
+		}
+		history.push(!(b.br_flags & BR_CONDITIONAL) || taken);
+	}
+
+	// the global history, for the target subsystem
+
+	uint32_t foldHistory(int length, int width) const {
+		uint64_t x = history.segment(length);
+		x ^= x >> 32;
+		return (uint32_t) ((x * 0x9e3779b97f4a7c15ull) >> (64 - width));
+	}
+
+	int historyLength(void) const {
+		return perceptron::HISTORY_LENGTH;
+	}
+
+	void storage(storage_report &r) const {
+		direction.storage(r);
+		r.add("global history", perceptron::HISTORY_LENGTH, STORAGE_REGISTER);
+		target_predictor::storage(r);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		direction.serialize(io);
+		history.serialize(io);
+		targets.serialize(io);
+	}
+
+private:
+	global_history history;
+	perceptron direction;
+	target_predictor targets;
+};
+
+#endif // PERCEPTRON_H
@@ -3,82 +3,406 @@
 // parameter: the name of a trace file.  It drives the branch predictor
 // simulation by reading the trace file and feeding the traces one at a time
 // to the branch predictor.
+//
+// The trace may be "-" for standard input, or a named pipe, so a live
+// trace can be piped in without landing on disk (see trace.cc).
+//
+// Options select the predictor and TAGE geometry without recompiling:
+//	-p name		use the predictor called name (default tage)
+//	-g name		use the registered geometry called name
+//	-f file		read geometry settings from a config file; these
+//			apply on top of -g (or the default geometry)
+//	-l		list the predictors and registered geometries and exit
+//	-V		drive the predictor through the virtual
+//			branch_predictor interface, one call per branch,
+//			instead of the batched static path
+//	-P n		profile each static branch and print the n with the
+//			most mispredictions
+//	-D file		profile each static branch and write all the counts
+//			to file (see profile.cc for the format)
+//	-s seed		seed the predictor's random number generators; a
+//			run is fully determined by the trace, predictor
+//			and seed (default 1)
+//	-i n		every n branches, record the interval's mispredictions
+//			and each component's hit rate (see series.cc)
+//	-o file		write those records to file rather than stdout; a
+//			name ending in .bin selects the binary format
+//	-w n		count the first n branches as warmup: they train the
+//			predictor but are left out of the final figures and
+//			the profile.  The final MPKI then charges the kept
+//			branches their share of the trace's instructions.
+//	-k n		skip the first n branches of the trace unseen
+//	-n n		simulate at most n branches
+//	-I index	take the trace's length from its index (see
+//			mkindex.cc) rather than reading the rest of the
+//			trace after a run that stops early
+//	-L file		start from the predictor state in checkpoint file,
+//			and from the trace position it was taken at unless
+//			-k says otherwise
+//	-S file		write a checkpoint of the final predictor state to
+//			file (see checkpoint.cc for the format)
+//	-r		print the hardware storage the predictor models,
+//			table by table (see storage.h)
+//	-b bits		refuse to run a predictor whose direction tables
+//			and registers model more than bits of storage; "cbp"
+//			is the CBP budget of 32 KB of tables and 256 bits
+//			more for registers.  The target subsystem is left
+//			out of either.
+//	-d n		delay each update until n more branches have been
+//			predicted, as in a pipeline with n branches in
+//			flight, and report how many direction mispredictions
+//			repaired the history (see simulate.h)
+//
+// With these a long trace can be cut into pieces run one after another or,
+// from checkpoints, at the same time.  A run over part of a trace charges
+// the branches it simulated their share of the trace's instructions, so it
+// needs the length of the whole trace: the index's count with -I, or else
+// the branches skipped, simulated and left unread, which are read to the
+// end just to be counted.
+//
+// Traces are read in batches of BATCH_SIZE and each batch is handed to the
+// predictor in one call (see simulate.h).  A batch is cut short at the end
+// of an interval or of the warmup, so the predictor loop never checks for
+// either.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> // in case you want to use e.g. memset
 #include <assert.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+using namespace std;
 
 #include "branch.h"
 #include "trace.h"
 #include "predictor.h"
-#include "my_predictor.h"
+#include "simulate.h"
+#include "profile.h"
+#include "series.h"
+#include "checkpoint.h"
+#include "tage_geometry.h"
+#include "registry.h"
+#include "storage.h"
+
+// number of traces handed to the predictor at once
+
+#define BATCH_SIZE	4096
+
+static trace batch[BATCH_SIZE];
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-p predictor] [-g geometry] [-f config] [-l] [-V] [-P n] [-D file] [-s seed] [-i n] [-o file] [-w n] [-k n] [-n n] [-I index] [-L file] [-S file] [-r] [-b bits] [-d n] <filename>.gz\n", prog);
+	exit (1);
+}
+
+// the number of the n traces that can run before the next multiple of
+// interval or the warmup ends, whichever comes first; 0 turns either off
+
+static size_t until_boundary (long long int branches, size_t n, long long int interval, long long int warmup) {
+	long long int left = n;
+	if (interval) left = min (left, interval - branches % interval);
+	if (branches < warmup) left = min (left, warmup - branches);
+	return left;
+}
+
+// what a checkpoint has to match: the predictor and, for TAGE, its geometry
+
+static string identity_of (const char *name, const tage_geometry &g) {
+	string id = name;
+	if (strcmp (name, "tage") == 0) {
+		char *text;
+		size_t length;
+		FILE *f = open_memstream (&text, &length);
+		print_geometry (f, g);
+		fclose (f);
+		id += "\n";
+		id += text;
+		free (text);
+	}
+	return id;
+}
+
+// mispredictions per 1000 of the given number of instructions
+
+static double mpki (long long int misses, double instructions) {
+	return 1000.0 * misses / instructions;
+}
 
 int main (int argc, char *argv[]) {
+	tage_geometry geometry;
+	const char *predictor_name = "tage";
+	bool virtual_calls = false;
+	int top_branches = 0;
+	const char *dump_file = NULL;
+	uint32_t seed = DEFAULT_SEED;
+	long long int interval = 0, warmup = 0;
+	const char *series_file = "-";
+	long long int skip = -1, count = 0;
+	const char *load_file = NULL, *save_file = NULL;
+	const char *index_file = NULL;
+	long long int depth = 0;
+	bool report_storage = false;
+	storage_budget budget = { 0, 0 };
+	int c;
+
+	// parse the options
+
+	while ((c = getopt (argc, argv, "p:g:f:lVP:D:s:i:o:w:k:n:I:L:S:rb:d:")) != -1) {
+		switch (c) {
+		case 'p':
+			predictor_name = optarg;
+			break;
+		case 'g':
+			if (!lookup_geometry (optarg, geometry)) {
+				fprintf (stderr, "%s: no geometry called \"%s\"; try -l\n", argv[0], optarg);
+				exit (1);
+			}
+			break;
+		case 'f':
+			if (!read_geometry_file (geometry, optarg)) exit (1);
+			break;
+		case 'l':
+			printf ("predictors:\n");
+			list_predictors (stdout);
+			printf ("geometries:\n");
+			list_geometries (stdout);
+			exit (0);
+		case 'V':
+			virtual_calls = true;
+			break;
+		case 'P':
+			top_branches = atoi (optarg);
+			break;
+		case 'D':
+			dump_file = optarg;
+			break;
+		case 's':
+			seed = strtoul (optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = atoll (optarg);
+			if (interval <= 0 || interval > 0xffffffffLL) usage (argv[0]);
+			break;
+		case 'o':
+			series_file = optarg;
+			break;
+		case 'w':
+			warmup = atoll (optarg);
+			if (warmup < 0) usage (argv[0]);
+			break;
+		case 'k':
+			skip = atoll (optarg);
+			if (skip < 0) usage (argv[0]);
+			break;
+		case 'n':
+			count = atoll (optarg);
+			if (count <= 0) usage (argv[0]);
+			break;
+		case 'I':
+			index_file = optarg;
+			break;
+		case 'L':
+			load_file = optarg;
+			break;
+		case 'S':
+			save_file = optarg;
+			break;
+		case 'r':
+			report_storage = true;
+			break;
+		case 'b':
+			if (!parse_budget (optarg, budget)) usage (argv[0]);
+			break;
+		case 'd':
+			depth = atoll (optarg);
+			if (depth < 0) usage (argv[0]);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
 
 	// make sure there is one parameter
 
-	if (argc != 2) {
-		fprintf (stderr, "Usage: %s <filename>.gz\n", argv[0]);
+	if (argc - optind != 1) usage (argv[0]);
+	const char *problem = check_geometry (geometry);
+	if (problem) {
+		fprintf (stderr, "%s: bad geometry: %s\n", argv[0], problem);
 		exit (1);
 	}
 
 	// open the trace file for reading
 
-	init_trace (argv[1]);
+	init_trace (argv[optind]);
 
 	// initialize competitor's branch prediction code
 
-	branch_predictor *p = new my_predictor ();
+	simulator *p = make_simulator (predictor_name, geometry, seed, virtual_calls);
+	string shown = string (predictor_name) + (virtual_calls ? " -V" : "");
+	if (!p) {
+		fprintf (stderr, "%s: no predictor called \"%s\"; try -l\n", argv[0], predictor_name);
+		exit (1);
+	}
+
+	// check the hardware the predictor models against the budget
+
+	if (report_storage || budget.given ()) {
+		storage_report r;
+		p->storage (r);
+		if (report_storage) r.print (stdout);
+		if (budget.given () && r.tables.empty ()) {
+			fprintf (stderr, "%s: predictor \"%s\" does not say how much storage it needs\n", argv[0],
+				shown.c_str ());
+			exit (1);
+		}
+		if (budget.given () && !budget.fits (r)) {
+			fprintf (stderr, "%s: predictor \"%s\" needs %llu bits of tables and %llu of registers, over the budget\n", argv[0],
+				shown.c_str (), (unsigned long long) r.total (STORAGE_TABLE), (unsigned long long) r.total (STORAGE_REGISTER));
+			exit (1);
+		}
+	}
+
+	// warm start from a checkpoint, normally where it left off
+
+	string identity = identity_of (predictor_name, geometry);
+	if (load_file) {
+		uint64_t position;
+		if (!read_checkpoint (load_file, identity.c_str (), position, p)) exit (1);
+		if (skip < 0) skip = position;
+	}
+	if (skip < 0) skip = 0;
+	if (depth && !p->delay (depth)) {
+		fprintf (stderr, "%s: predictor \"%s\" cannot delay its updates\n", argv[0],
+			shown.c_str ());
+		exit (1);
+	}
+
+	// skip the part of the trace before the start
+
+	for (long long int i = 0; i < skip; i++) {
+		if (!read_trace ()) {
+			fprintf (stderr, "%s: the trace ends before branch %lld\n", argv[0], skip);
+			exit (1);
+		}
+	}
 
 	// some statistics to keep, currently just for conditional branches
 
-	long long int 
-		tmiss = 0, 	// number of target mispredictions
-		dmiss = 0; 	// number of direction mispredictions
+	sim_stats stats;
+	branch_profile *profile = NULL;
+	if (top_branches > 0 || dump_file) profile = new branch_profile;
+	if (!warmup) stats.profile = profile;
+	interval_series *series = NULL;
+	provider_counts providers;
+	if (interval) {
+		series = interval_series::open (series_file, interval);
+		if (!series) exit (1);
+		stats.providers = &providers;
+	}
+
+	// what had been counted when the warmup ended
+
+	sim_stats warm;
 
 	// keep looping until end of file
 
 	for (;;) {
 
-		// get a trace
+		// get a batch of traces
 
-		trace *t = read_trace ();
+		size_t want = BATCH_SIZE;
+		if (count && count - stats.branches < (long long int) want) want = count - stats.branches;
 
-		// NULL means end of file
+		// 0 means end of file
 
-		if (!t) break;
+		size_t n = want ? read_traces (batch, want) : 0;
+		if (n == 0) break;
 
-		// send this trace to the competitor's code for prediction
+		// send the batch to the competitor's code for prediction
+		// and update, stopping at each interval and warmup boundary
 
-		branch_update *u = p->predict (t->bi);
+		for (size_t done = 0; done < n; ) {
+			size_t k = until_boundary (stats.branches, n - done, interval, warmup);
+			p->run (batch + done, k, stats);
+			done += k;
+			if (interval && stats.branches % interval == 0) series->record (stats);
+			if (warmup && stats.branches == warmup) {
+				warm = stats;
+				stats.profile = profile;
+			}
+		}
+	}
 
-		// collect statistics for a conditional branch trace
+	// the length of the whole trace, for the share of its instructions
+	// the run covers
 
-		if (t->bi.br_flags & BR_CONDITIONAL) {
+	long long int total = skip + stats.branches;
+	if (index_file) {
+		uint32_t index_interval;
+		uint64_t traces;
+		if (!index_info (index_file, index_interval, traces)) exit (1);
+		total = traces;
+		if (total < skip + stats.branches) {
+			fprintf (stderr, "%s: %s indexes only %lld branches\n", argv[0], index_file, total);
+			exit (1);
+		}
+	} else if (count && stats.branches == count) {
+		size_t n;
+		while ((n = read_traces (batch, BATCH_SIZE)) > 0) total += n;
+	}
 
-			// count a direction misprediction
+	// done reading traces; train on the branches still in flight
 
-			dmiss += u->direction_prediction () != t->taken;
+	end_trace ();
+	p->drain (stats);
 
-			// count a target misprediction
+	// save the final state, with the position of the next branch
 
-			tmiss += u->target_prediction () != t->target;
-		}
+	if (save_file && !write_checkpoint (save_file, identity.c_str (), skip + stats.branches, p)) exit (1);
 
-		// update competitor's state
+	// record the last, partial interval
 
-		p->update (u, t->taken, t->target);
+	if (series) {
+		if (stats.branches % interval) series->record (stats);
+		if (!series->close ()) exit (1);
+		delete series;
+	}
+	if (warmup && stats.branches <= warmup) {
+		fprintf (stderr, "%s: the trace has only %lld branches, all of them warmup\n", argv[0], stats.branches);
+		exit (1);
 	}
 
-	// done reading traces
+	// report the profile, if any
 
-	end_trace ();
+	if (profile) {
+		if (top_branches > 0) profile->report (stdout, top_branches);
+		if (dump_file && !profile->dump (dump_file)) exit (1);
+		delete profile;
+	}
 
 	// give final mispredictions per kilo-instruction and exit.
-	// each trace represents exactly 100 million instructions.
+	// each trace represents exactly 100 million instructions; the
+	// branches simulated, less any warmup, are taken to represent their
+	// share of the whole trace.  target mispredictions come first so the
+	// last line stays the direction MPKI.
 
-	printf ("%0.3f MPKI\n", 1000.0 * (dmiss / 1e8));
+	double instructions = 1e8 * (stats.branches - warm.branches) / total;
+	long long int tmiss = stats.tmiss - warm.tmiss;
+	long long int tmiss_indirect = stats.tmiss_indirect - warm.tmiss_indirect;
+	long long int tmiss_return = stats.tmiss_return - warm.tmiss_return;
+	printf ("%0.3f target MPKI (%0.3f direct, %0.3f indirect, %0.3f return)\n",
+		mpki (tmiss, instructions),
+		mpki (tmiss - tmiss_indirect - tmiss_return, instructions),
+		mpki (tmiss_indirect, instructions),
+		mpki (tmiss_return, instructions));
+	if (depth) {
+		long long int repairs = stats.repairs - warm.repairs;
+		int bits = p->checkpoint_bits ();
+		printf ("%lld in flight: %lld repairs, %d checkpoint bits per branch (%lld in all)\n",
+			depth, repairs, bits, bits * depth);
+	}
+	printf ("%0.3f MPKI\n", mpki (stats.dmiss - warm.dmiss, instructions));
 	delete p;
 	exit (0);
 }
@@ -0,0 +1,279 @@
+// predict_bench.cc
+// This file contains the throughput benchmark.  For each trace it times,
+// separately:
+//	decode		reading the whole trace, both one trace per read_trace
+//			call and in batches, in traces and input bytes per
+//			second
+//	predict		each predictor's predict and update over the trace
+//			already decoded into memory, in nanoseconds per branch
+//	end to end	opening, decoding and simulating the trace with each
+//			predictor, as predict does, in seconds and
+//			nanoseconds per branch
+// Each figure is the best of some rounds, since anything else running
+// only ever makes a round slower.  The results are written as JSON, so
+// runs can be kept and compared to catch regressions.  Synthetic traces
+// come from tracegen; "make bench" times one and some of the real traces.
+//
+// Usage: predict_bench [-p predictor]... [-r rounds] [-n branches] [-o file]
+//		        trace...
+//	-p predictor	time this predictor (default: bimodal and tage); may
+//			be given more than once
+//	-r rounds	rounds to take the best of (default 3)
+//	-n branches	use only the first n branches of each trace
+//	-o file		write the JSON to file rather than stdout
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+#include "simulate.h"
+#include "tage_geometry.h"
+#include "registry.h"
+
+#define BATCH_SIZE	4096
+
+static vector<const char *> predictors;
+static int rounds = 3;
+static uint64_t limit = 0;
+
+struct predictor_result {
+	const char *name;
+	double predict_seconds, end_to_end_seconds;
+	long long int dmiss, tmiss;
+};
+
+struct trace_result {
+	const char *name;
+	uint64_t bytes, branches;
+	double single_seconds, batch_seconds;
+	vector<predictor_result> predictors;
+};
+
+static double now (void) {
+	return chrono::duration<double> (chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+static bool more (uint64_t n) {
+	return !limit || n < limit;
+}
+
+// read the whole trace one trace at a time, returning the count
+
+static uint64_t decode_single (const char *fname) {
+	trace_reader r;
+	if (!r.open (fname)) exit (1);
+	uint64_t n = 0;
+	while (more (n) && r.read ()) n++;
+	r.close ();
+	return n;
+}
+
+// read the whole trace in batches, into v if it is given
+
+static uint64_t decode_batch (const char *fname, vector<trace> *v) {
+	trace_reader r;
+	static trace batch[BATCH_SIZE];
+	if (!r.open (fname)) exit (1);
+	uint64_t n = 0;
+	for (;;) {
+		size_t want = BATCH_SIZE;
+		if (limit && limit - n < want) want = limit - n;
+		size_t k = want ? r.read (batch, want) : 0;
+		if (k == 0) break;
+		if (v) v->insert (v->end (), batch, batch + k);
+		n += k;
+	}
+	r.close ();
+	return n;
+}
+
+static simulator *make (const char *name) {
+	simulator *p = make_simulator (name, tage_geometry ());
+	if (!p) {
+		fprintf (stderr, "no predictor called \"%s\"\n", name);
+		exit (1);
+	}
+	return p;
+}
+
+// predict and update over traces already in memory; the predictor is
+// built outside the timing
+
+static double time_predict (const char *name, const vector<trace> &v, sim_stats &s) {
+	simulator *p = make (name);
+	double start = now ();
+	for (size_t i = 0; i < v.size (); i += BATCH_SIZE)
+		p->run (&v[i], min ((size_t) BATCH_SIZE, v.size () - i), s);
+	double t = now () - start;
+	delete p;
+	return t;
+}
+
+// everything predict does but count instructions and print
+
+static double time_end_to_end (const char *name, const char *fname) {
+	static trace batch[BATCH_SIZE];
+	double start = now ();
+	simulator *p = make (name);
+	trace_reader r;
+	sim_stats s;
+	if (!r.open (fname)) exit (1);
+	for (;;) {
+		size_t want = BATCH_SIZE;
+		if (limit && limit - s.branches < want) want = limit - s.branches;
+		size_t k = want ? r.read (batch, want) : 0;
+		if (k == 0) break;
+		p->run (batch, k, s);
+	}
+	r.close ();
+	delete p;
+	return now () - start;
+}
+
+static trace_result bench (const char *fname) {
+	trace_result t;
+	struct stat st;
+	t.name = fname;
+	t.bytes = stat (fname, &st) == 0 ? st.st_size : 0;
+	t.single_seconds = t.batch_seconds = 1e30;
+
+	vector<trace> v;
+	t.branches = decode_batch (fname, &v);
+	if (t.branches == 0) {
+		fprintf (stderr, "%s: no traces\n", fname);
+		exit (1);
+	}
+	for (int i = 0; i < rounds; i++) {
+		double start = now ();
+		decode_single (fname);
+		t.single_seconds = min (t.single_seconds, now () - start);
+		start = now ();
+		decode_batch (fname, NULL);
+		t.batch_seconds = min (t.batch_seconds, now () - start);
+	}
+	for (size_t j = 0; j < predictors.size (); j++) {
+		predictor_result p;
+		p.name = predictors[j];
+		p.predict_seconds = p.end_to_end_seconds = 1e30;
+		for (int i = 0; i < rounds; i++) {
+			sim_stats s;
+			p.predict_seconds = min (p.predict_seconds, time_predict (p.name, v, s));
+			p.dmiss = s.dmiss;
+			p.tmiss = s.tmiss;
+			p.end_to_end_seconds = min (p.end_to_end_seconds, time_end_to_end (p.name, fname));
+		}
+		t.predictors.push_back (p);
+	}
+	return t;
+}
+
+// s as a JSON string
+
+static string quoted (const char *s) {
+	string q = "\"";
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') q += '\\';
+		if ((unsigned char) *s < 0x20) {
+			char e[8];
+			snprintf (e, sizeof e, "\\u%04x", *s);
+			q += e;
+		} else {
+			q += *s;
+		}
+	}
+	return q + "\"";
+}
+
+static void write_json (FILE *f, const vector<trace_result> &results) {
+	fprintf (f, "{\n\t\"rounds\": %d,\n\t\"traces\": [", rounds);
+	for (size_t i = 0; i < results.size (); i++) {
+		const trace_result &t = results[i];
+		double n = t.branches;
+		fprintf (f, "%s\n\t\t{\n", i ? "," : "");
+		fprintf (f, "\t\t\t\"trace\": %s,\n", quoted (t.name).c_str ());
+		fprintf (f, "\t\t\t\"bytes\": %llu,\n", (unsigned long long) t.bytes);
+		fprintf (f, "\t\t\t\"branches\": %llu,\n", (unsigned long long) t.branches);
+		fprintf (f, "\t\t\t\"decode\": {\n");
+		fprintf (f, "\t\t\t\t\"single_seconds\": %.6f,\n", t.single_seconds);
+		fprintf (f, "\t\t\t\t\"single_traces_per_second\": %.0f,\n", n / t.single_seconds);
+		fprintf (f, "\t\t\t\t\"batch_seconds\": %.6f,\n", t.batch_seconds);
+		fprintf (f, "\t\t\t\t\"batch_traces_per_second\": %.0f,\n", n / t.batch_seconds);
+
+		// input bytes only mean something if all of them were read
+
+		if (limit && t.branches == limit)
+			fprintf (f, "\t\t\t\t\"batch_bytes_per_second\": null\n");
+		else
+			fprintf (f, "\t\t\t\t\"batch_bytes_per_second\": %.0f\n", t.bytes / t.batch_seconds);
+		fprintf (f, "\t\t\t},\n\t\t\t\"predictors\": [");
+		for (size_t j = 0; j < t.predictors.size (); j++) {
+			const predictor_result &p = t.predictors[j];
+			fprintf (f, "%s\n\t\t\t\t{\n", j ? "," : "");
+			fprintf (f, "\t\t\t\t\t\"predictor\": %s,\n", quoted (p.name).c_str ());
+			fprintf (f, "\t\t\t\t\t\"predict_ns_per_branch\": %.3f,\n", 1e9 * p.predict_seconds / n);
+			fprintf (f, "\t\t\t\t\t\"end_to_end_seconds\": %.6f,\n", p.end_to_end_seconds);
+			fprintf (f, "\t\t\t\t\t\"end_to_end_ns_per_branch\": %.3f,\n", 1e9 * p.end_to_end_seconds / n);
+			fprintf (f, "\t\t\t\t\t\"direction_mispredictions\": %lld,\n", p.dmiss);
+			fprintf (f, "\t\t\t\t\t\"target_mispredictions\": %lld\n", p.tmiss);
+			fprintf (f, "\t\t\t\t}");
+		}
+		fprintf (f, "\n\t\t\t]\n\t\t}");
+	}
+	fprintf (f, "\n\t]\n}\n");
+}
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-p predictor]... [-r rounds] [-n branches] [-o file] trace...\n", prog);
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	const char *output = NULL;
+	int c;
+
+	while ((c = getopt (argc, argv, "p:r:n:o:")) != -1) {
+		switch (c) {
+		case 'p': predictors.push_back (optarg); break;
+		case 'r':
+			rounds = atoi (optarg);
+			if (rounds < 1) usage (argv[0]);
+			break;
+		case 'n': limit = atoll (optarg); break;
+		case 'o': output = optarg; break;
+		default: usage (argv[0]);
+		}
+	}
+	if (optind == argc) usage (argv[0]);
+	if (predictors.empty ()) {
+		predictors.push_back ("bimodal");
+		predictors.push_back ("tage");
+	}
+	for (size_t j = 0; j < predictors.size (); j++) delete make (predictors[j]);
+
+	vector<trace_result> results;
+	for (int i = optind; i < argc; i++) {
+		fprintf (stderr, "timing \"%s\"\n", argv[i]);
+		results.push_back (bench (argv[i]));
+	}
+
+	FILE *f = output ? fopen (output, "w") : stdout;
+	if (!f) {
+		perror (output);
+		exit (1);
+	}
+	write_json (f, results);
+	if (fclose (f) != 0) {
+		perror (output);
+		exit (1);
+	}
+	exit (0);
+}
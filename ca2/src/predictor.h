@@ -1,24 +1,55 @@
 // predictor.h
 // This file declares branch_update and branch_predictor classes.
 
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <stdio.h>
+#include <stddef.h>
+
 class branch_update {
 	bool _direction_prediction;
 	unsigned int _target_prediction;
 
+	// optional detail for profiling; predictors that have no components
+	// can ignore these
+
+	int _provider;		// component that supplied the prediction, -1 if unknown
+	int _allocated;		// component update() allocated an entry in, 0 if none
+	bool _evicted;		// that allocation replaced an entry in use
+
 public:
 	bool direction_prediction () { return _direction_prediction; }
 	void direction_prediction (bool b) { _direction_prediction = b; }
 
-	bool target_prediction () { return _target_prediction; }
+	unsigned int target_prediction () { return _target_prediction; }
 	void target_prediction (unsigned int t) { _target_prediction = t; }
 
+	int provider () { return _provider; }
+	void provider (int p) { _provider = p; }
+
+	int allocated () { return _allocated; }
+	bool evicted () { return _evicted; }
+	void allocated (int c, bool e) { _allocated = c; _evicted = e; }
+
 	branch_update (void) : 
-		_direction_prediction(false), _target_prediction(0) {}
+		_direction_prediction(false), _target_prediction(0),
+		_provider(-1), _allocated(0), _evicted(false) {}
 };
 
 class branch_predictor {
 public:
 	virtual branch_update *predict (branch_info &) = 0;
 	virtual void update (branch_update *, bool, unsigned int) {}
+
+	// the predictor's whole state, for checkpoints (see state.h): its
+	// size in bytes, and writing it to or reading it from f.  a
+	// predictor that cannot be checkpointed has size 0.
+
+	virtual size_t state_size (void) { return 0; }
+	virtual bool save_state (FILE *) { return false; }
+	virtual bool load_state (FILE *) { return false; }
 	virtual ~branch_predictor (void) {}
 };
+
+#endif // PREDICTOR_H
@@ -0,0 +1,135 @@
+// profile.cc
+// This file contains the per-branch profiler's table management, report
+// and binary dump.
+//
+// The dump is a 16-byte header followed by one record per static branch:
+//	"BPRF"			magic
+//	uint32_t version	1
+//	uint32_t count		number of records
+//	uint32_t components	PROFILE_COMPONENTS
+// and each record is a branch_counts, 5 + PROFILE_COMPONENTS uint32_t's,
+// in no particular order.  All integers are written little-endian,
+// whatever the host's byte order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "profile.h"
+
+branch_profile::branch_profile (void) : capacity (1 << 12), used (0) {
+	keys = new uint64_t[capacity];
+	counts = new branch_counts[capacity];
+	memset (keys, 0xff, capacity * sizeof *keys);
+}
+
+branch_profile::~branch_profile (void) {
+	delete [] keys;
+	delete [] counts;
+}
+
+branch_counts &branch_profile::insert (uint32_t slot, uint32_t address) {
+
+	// keep the table at most half full so probes stay short
+
+	if (2 * (used + 1) > capacity) {
+		grow ();
+		return find (address);
+	}
+	used++;
+	keys[slot] = address;
+	memset (&counts[slot], 0, sizeof counts[slot]);
+	counts[slot].address = address;
+	return counts[slot];
+}
+
+void branch_profile::grow (void) {
+	uint64_t *old_keys = keys;
+	branch_counts *old_counts = counts;
+	uint32_t old_capacity = capacity;
+
+	capacity *= 2;
+	keys = new uint64_t[capacity];
+	counts = new branch_counts[capacity];
+	memset (keys, 0xff, capacity * sizeof *keys);
+	for (uint32_t i = 0; i < old_capacity; i++) {
+		if (old_keys[i] == EMPTY) continue;
+		uint32_t j = slot_of (old_counts[i].address);
+		while (keys[j] != EMPTY) j = (j + 1) & (capacity - 1);
+		keys[j] = old_keys[i];
+		counts[j] = old_counts[i];
+	}
+	delete [] old_keys;
+	delete [] old_counts;
+}
+
+static bool more_mispredictions (const branch_counts *a, const branch_counts *b) {
+	if (a->mispredictions != b->mispredictions) return a->mispredictions > b->mispredictions;
+	return a->address < b->address;
+}
+
+void branch_profile::report (FILE *f, int n) const {
+	vector<const branch_counts *> v;
+	unsigned long long total = 0;
+	for (uint32_t i = 0; i < capacity; i++) {
+		if (keys[i] == EMPTY) continue;
+		v.push_back (&counts[i]);
+		total += counts[i].mispredictions;
+	}
+	sort (v.begin (), v.end (), more_mispredictions);
+	if (n > (int) v.size ()) n = v.size ();
+
+	fprintf (f, "%u static conditional branches, %llu mispredictions\n", used, total);
+	fprintf (f, "%-10s %10s %10s %7s %7s %8s %6s %6s\n",
+		"address", "execs", "misses", "rate", "share", "provider", "alloc", "evict");
+	for (int i = 0; i < n; i++) {
+		const branch_counts &c = *v[i];
+
+		// the component that supplied most of this branch's predictions
+
+		int top = 0;
+		for (int p = 1; p < PROFILE_COMPONENTS; p++)
+			if (c.provided[p] > c.provided[top]) top = p;
+		fprintf (f, "0x%08x %10u %10u %6.2f%% %6.2f%% %5d:%2.0f%% %6u %6u\n",
+			c.address, c.executions, c.mispredictions,
+			100.0 * c.mispredictions / c.executions,
+			total ? 100.0 * c.mispredictions / total : 0.0,
+			top, c.executions ? 100.0 * c.provided[top] / c.executions : 0.0,
+			c.allocations, c.evictions);
+	}
+}
+
+// write n uint32_t's little-endian
+
+static void write_words (FILE *f, const uint32_t *w, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		unsigned char b[4] = { (unsigned char) w[i], (unsigned char) (w[i] >> 8),
+			(unsigned char) (w[i] >> 16), (unsigned char) (w[i] >> 24) };
+		fwrite (b, 1, 4, f);
+	}
+}
+
+bool branch_profile::dump (const char *fname) const {
+	FILE *f = fopen (fname, "wb");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+	uint32_t header[3] = { 1, used, PROFILE_COMPONENTS };
+	fwrite ("BPRF", 1, 4, f);
+	write_words (f, header, 3);
+	for (uint32_t i = 0; i < capacity; i++) {
+		if (keys[i] == EMPTY) continue;
+		const branch_counts &c = counts[i];
+		uint32_t fixed[5] = { c.address, c.executions, c.mispredictions, c.allocations, c.evictions };
+		write_words (f, fixed, 5);
+		write_words (f, c.provided, PROFILE_COMPONENTS);
+	}
+	bool ok = !ferror (f);
+	if (fclose (f) != 0) ok = false;
+	if (!ok) perror (fname);
+	return ok;
+}
@@ -0,0 +1,89 @@
+// profile.h
+// This file declares the per-branch misprediction profiler.  For every
+// static conditional branch it counts executions, mispredictions, which
+// predictor component supplied each prediction, and the allocations and
+// evictions the branch caused.
+//
+// The counts live in an open-addressing hash table keyed on the branch
+// address, with linear probing.  Keys are kept in their own array so a
+// probe touches one dense cache line; the counts for a branch are only
+// touched once its slot is found.  A key is 64 bits wide, so the empty
+// marker is no 32-bit address.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+
+// components a profile can tell apart: the base predictor (0) and up to 16
+// tagged components
+
+#define PROFILE_COMPONENTS	17
+
+struct branch_counts {
+	uint32_t address;
+	uint32_t executions;
+	uint32_t mispredictions;
+	uint32_t allocations;
+	uint32_t evictions;
+	uint32_t provided[PROFILE_COMPONENTS];	// predictions by each component
+};
+
+class branch_profile {
+public:
+	branch_profile (void);
+	~branch_profile (void);
+
+	// record one conditional branch after its update
+
+	void record (const trace &t, branch_update &u) {
+		branch_counts &c = find (t.bi.address);
+		c.executions++;
+		c.mispredictions += u.direction_prediction () != t.taken;
+		int p = u.provider ();
+		if (p >= 0 && p < PROFILE_COMPONENTS) c.provided[p]++;
+		if (u.allocated ()) {
+			c.allocations++;
+			c.evictions += u.evicted ();
+		}
+	}
+
+	// print the n branches with the most mispredictions
+
+	void report (FILE *f, int n) const;
+
+	// write every branch's counts to fname; returns false on error
+
+	bool dump (const char *fname) const;
+
+private:
+	static const uint64_t EMPTY = ~(uint64_t) 0;
+
+	uint64_t *keys;
+	branch_counts *counts;
+	uint32_t capacity;	// a power of two
+	uint32_t used;
+
+	uint32_t slot_of (uint32_t address) const {
+		return (address * 0x9e3779b1u) & (capacity - 1);
+	}
+
+	branch_counts &find (uint32_t address) {
+		uint32_t i = slot_of (address);
+		for (;;) {
+			if (keys[i] == address) return counts[i];
+			if (keys[i] == EMPTY) return insert (i, address);
+			i = (i + 1) & (capacity - 1);
+		}
+	}
+
+	branch_counts &insert (uint32_t slot, uint32_t address);
+	void grow (void);
+};
+
+#endif // PROFILE_H
@@ -0,0 +1,129 @@
+// registry.cc
+// This file instantiates the specialized predictor kernels.  To add a TAGE
+// geometry, define a static geometry in tage_geometry.h and add a line to
+// geometry_registry; to add a predictor, give it the static interface (see
+// simulate.h) and add a line to predictor_registry; an ensemble of
+// components (see ensemble.h) is added the same way, by its types.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "registry.h"
+#include "my_predictor.h"
+#include "bimodal.h"
+#include "perceptron.h"
+#include "gshare.h"
+#include "local.h"
+#include "ensemble.h"
+
+template <class G>
+static simulator *make_static (uint32_t seed) {
+	return new static_simulator<tage_predictor<G> > (G (), seed);
+}
+
+#define REGISTER(name, G) { name, describe_geometry (G ()), make_static<G> }
+
+const registered_geometry geometry_registry[] = {
+	REGISTER ("default", geometry_default),
+	REGISTER ("default-scl", geometry_default_scl),
+	REGISTER ("default-local", geometry_default_local),
+	REGISTER ("small", geometry_small),
+	REGISTER ("large", geometry_large),
+	{ NULL, tage_geometry (), NULL }
+};
+
+bool lookup_geometry (const char *name, tage_geometry &g) {
+	for (const registered_geometry *r = geometry_registry; r->name; r++) {
+		if (strcmp (r->name, name) == 0) {
+			g = r->geometry;
+			return true;
+		}
+	}
+	return false;
+}
+
+simulator *make_tage_simulator (const tage_geometry &g, uint32_t seed, bool *specialized) {
+	for (const registered_geometry *r = geometry_registry; r->name; r++) {
+		if (same_geometry (r->geometry, g)) {
+			if (specialized) *specialized = true;
+			return r->make (seed);
+		}
+	}
+	if (specialized) *specialized = false;
+	return new static_simulator<tage_predictor<tage_geometry> > (g, seed);
+}
+
+branch_predictor *make_tage_predictor (const tage_geometry &g, uint32_t seed) {
+	return new predictor_adapter<tage_predictor<tage_geometry> > (g, seed);
+}
+
+void list_geometries (FILE *f) {
+	for (const registered_geometry *r = geometry_registry; r->name; r++) {
+		const tage_geometry &g = r->geometry;
+		fprintf (f, "%-10s %u components, 2^%u entries each, 2^%u bimodal, histories %u..%u\n",
+			r->name, g.component_count, g.index_length, g.bimodal_index_length,
+			g.history_length[0], g.history_length[g.component_count - 1]);
+	}
+}
+
+// P built from a, behind the static or the virtual interface
+
+template <class P, class... A>
+static simulator *make_either (bool virtual_calls, const A &... a) {
+	if (virtual_calls) return new virtual_simulator (new predictor_adapter<P> (a...));
+	return new static_simulator<P> (a...);
+}
+
+static simulator *make_tage (const tage_geometry &g, uint32_t seed, bool virtual_calls) {
+	if (virtual_calls) return new virtual_simulator (make_tage_predictor (g, seed));
+	return make_tage_simulator (g, seed);
+}
+
+static simulator *make_bimodal (const tage_geometry &, uint32_t, bool virtual_calls) {
+	return make_either<bimodal_predictor> (virtual_calls);
+}
+
+static simulator *make_perceptron (const tage_geometry &, uint32_t seed, bool virtual_calls) {
+	return make_either<perceptron_predictor> (virtual_calls, seed);
+}
+
+static simulator *make_tournament (const tage_geometry &, uint32_t seed, bool virtual_calls) {
+	return make_either<ensemble<meta_chooser, bimodal_table, gshare> > (virtual_calls, seed);
+}
+
+static simulator *make_alpha (const tage_geometry &, uint32_t seed, bool virtual_calls) {
+	return make_either<ensemble<meta_chooser, local_predictor, gshare> > (virtual_calls, seed);
+}
+
+static simulator *make_ensemble (const tage_geometry &, uint32_t seed, bool virtual_calls) {
+	return make_either<ensemble<vote_chooser, bimodal_table, gshare, Tage<geometry_default>, perceptron> > (virtual_calls, seed);
+}
+
+struct registered_predictor {
+	const char *name;
+	const char *description;
+	simulator *(*make) (const tage_geometry &, uint32_t seed, bool virtual_calls);
+};
+
+static const registered_predictor predictor_registry[] = {
+	{ "tage", "TAGE with the geometry from -g/-f (the default)", make_tage },
+	{ "bimodal", "2^14 2-bit counters indexed by address", make_bimodal },
+	{ "perceptron", "hashed perceptron over global and local history", make_perceptron },
+	{ "tournament", "bimodal (0) and gshare (1), chosen per branch by meta counters", make_tournament },
+	{ "alpha", "two-level local (0) and gshare (1), chosen per branch by meta counters", make_alpha },
+	{ "ensemble", "bimodal (0), gshare (1), default TAGE (2) and perceptron (3), combined by a perceptron vote", make_ensemble },
+	{ NULL, NULL, NULL }
+};
+
+simulator *make_simulator (const char *name, const tage_geometry &g, uint32_t seed, bool virtual_calls) {
+	for (const registered_predictor *r = predictor_registry; r->name; r++) {
+		if (strcmp (r->name, name) == 0) return r->make (g, seed, virtual_calls);
+	}
+	return NULL;
+}
+
+void list_predictors (FILE *f) {
+	for (const registered_predictor *r = predictor_registry; r->name; r++) {
+		fprintf (f, "%-10s %s\n", r->name, r->description);
+	}
+}
@@ -0,0 +1,52 @@
+// registry.h
+// This file declares the registry of predictors predict can build, and of
+// the TAGE geometries that have a kernel compiled specially for them.  Any
+// other geometry still works; it just runs on the generic
+// Tage<tage_geometry> instantiation.
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdio.h>
+
+#include "branch.h"
+#include "predictor.h"
+#include "simulate.h"
+#include "tage_geometry.h"
+#include "xorshift.h"
+
+struct registered_geometry {
+	const char *name;
+	tage_geometry geometry;
+	simulator *(*make) (uint32_t seed);
+};
+
+// the registered geometries, terminated by an entry with a NULL name
+
+extern const registered_geometry geometry_registry[];
+
+// copy the geometry called name into g; returns false if there is none
+
+bool lookup_geometry (const char *name, tage_geometry &g);
+
+// build a TAGE simulator for g, using a specialized kernel when g is one
+// of the registered geometries.  *specialized, if given, says which.  seed
+// seeds the predictor's random number generators.
+
+simulator *make_tage_simulator (const tage_geometry &g, uint32_t seed = DEFAULT_SEED, bool *specialized = NULL);
+
+// the same predictor behind the old branch_predictor interface
+
+branch_predictor *make_tage_predictor (const tage_geometry &g, uint32_t seed = DEFAULT_SEED);
+
+void list_geometries (FILE *f);
+
+// build the predictor called name ("tage" uses g); NULL if there is none.
+// with virtual_calls it is driven through the branch_predictor interface,
+// one virtual call per branch, rather than the batched static path.
+
+simulator *make_simulator (const char *name, const tage_geometry &g, uint32_t seed = DEFAULT_SEED, bool virtual_calls = false);
+
+void list_predictors (FILE *f);
+
+#endif // REGISTRY_H
@@ -0,0 +1,98 @@
+// series.cc
+// This file contains the interval time series writer.
+//
+// The CSV has a header line and then one line per interval:
+//	end		branches seen when the interval ended
+//	branches	branches in the interval
+//	conditional	... of which conditional
+//	dmiss, tmiss	direction and target mispredictions
+//	mpkb		direction mispredictions per 1000 branches
+//	miss_rate	direction mispredictions per conditional branch
+//	hit0..hit16	the fraction of component i's predictions that were
+//			right, empty if it supplied none
+//
+// The binary form is a 16-byte header followed by one record per interval:
+//	"BSER"			magic
+//	uint32_t version	1
+//	uint32_t components	PROFILE_COMPONENTS
+//	uint32_t interval	branches per interval
+// and each record is 5 + 2 * PROFILE_COMPONENTS little-endian int64_t's:
+// end, branches, conditional, dmiss, tmiss, then the predictions each
+// component supplied and then how many of those were right.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "series.h"
+
+interval_series::interval_series (FILE *f, const char *name, bool binary)
+	: f (f), name (name), binary (binary) {}
+
+interval_series::~interval_series (void) {
+	if (f) close ();
+}
+
+interval_series *interval_series::open (const char *fname, long long int interval) {
+	size_t n = strlen (fname);
+	bool binary = n > 4 && strcmp (fname + n - 4, ".bin") == 0;
+	FILE *f = strcmp (fname, "-") == 0 ? stdout : fopen (fname, binary ? "wb" : "w");
+	if (!f) {
+		perror (fname);
+		return NULL;
+	}
+	if (binary) {
+		uint32_t header[3] = { 1, PROFILE_COMPONENTS, (uint32_t) interval };
+		fwrite ("BSER", 1, 4, f);
+		fwrite (header, sizeof header, 1, f);
+	} else {
+		fprintf (f, "end,branches,conditional,dmiss,tmiss,mpkb,miss_rate");
+		for (int i = 0; i < PROFILE_COMPONENTS; i++) fprintf (f, ",hit%d", i);
+		fprintf (f, "\n");
+	}
+	return new interval_series (f, fname, binary);
+}
+
+void interval_series::record (const sim_stats &s) {
+	int64_t branches = s.branches - last.branches;
+	int64_t conditional = s.conditional - last.conditional;
+	int64_t dmiss = s.dmiss - last.dmiss;
+	int64_t tmiss = s.tmiss - last.tmiss;
+	int64_t used[PROFILE_COMPONENTS], correct[PROFILE_COMPONENTS];
+	for (int i = 0; i < PROFILE_COMPONENTS; i++) {
+		used[i] = s.providers->used[i] - last_providers.used[i];
+		correct[i] = s.providers->correct[i] - last_providers.correct[i];
+	}
+
+	if (binary) {
+		int64_t head[5] = { s.branches, branches, conditional, dmiss, tmiss };
+		fwrite (head, sizeof head, 1, f);
+		fwrite (used, sizeof used, 1, f);
+		fwrite (correct, sizeof correct, 1, f);
+	} else {
+		fprintf (f, "%lld,%lld,%lld,%lld,%lld,%.3f,%.5f",
+			(long long) s.branches, (long long) branches, (long long) conditional,
+			(long long) dmiss, (long long) tmiss,
+			branches ? 1000.0 * dmiss / branches : 0.0,
+			conditional ? (double) dmiss / conditional : 0.0);
+		for (int i = 0; i < PROFILE_COMPONENTS; i++) {
+			if (used[i]) fprintf (f, ",%.4f", (double) correct[i] / used[i]);
+			else fprintf (f, ",");
+		}
+		fprintf (f, "\n");
+	}
+	last = s;
+	last_providers = *s.providers;
+}
+
+bool interval_series::close (void) {
+	bool ok = !ferror (f);
+	if (f == stdout) {
+		if (fflush (f) != 0) ok = false;
+	} else if (fclose (f) != 0) {
+		ok = false;
+	}
+	f = NULL;
+	if (!ok) perror (name);
+	return ok;
+}
@@ -0,0 +1,47 @@
+// series.h
+// This file declares the interval time series: every so many branches the
+// driver records how the last interval went, so warmup and program phases
+// show up instead of vanishing into one final figure.
+//
+// The trace does not say how many instructions lie between branches, only
+// that the whole trace is 100 million, so intervals are measured in
+// branches and their miss rates are per 1000 branches.  Within one trace
+// that is MPKI times a constant.
+
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <stdio.h>
+
+#include "simulate.h"
+
+class interval_series {
+public:
+	~interval_series (void);
+
+	// start a series in fname, or on stdout if fname is "-".  a name
+	// ending in ".bin" gets the binary format, anything else CSV.
+	// returns NULL on error.
+
+	static interval_series *open (const char *fname, long long int interval);
+
+	// record the interval that ends now, from what s has counted since
+	// the last call.  s must have providers.
+
+	void record (const sim_stats &s);
+
+	// finish the file; returns false on error
+
+	bool close (void);
+
+private:
+	FILE *f;
+	const char *name;
+	bool binary;
+	sim_stats last;
+	provider_counts last_providers;
+
+	interval_series (FILE *f, const char *name, bool binary);
+};
+
+#endif // SERIES_H
@@ -0,0 +1,348 @@
+// simulate.h
+// This file declares the batched, statically dispatched simulation path.
+//
+// A predictor with the static interface is a plain class with
+//
+//	typedef ... update_type;	// a branch_update subclass
+//	void predict (const branch_info &, update_type &);
+//	void update (const branch_info &, update_type &, bool taken, unsigned int target);
+//	template <class IO> void serialize (IO &);	// see state.h
+//	void storage (storage_report &) const;		// see storage.h
+//
+// and no virtual functions.  simulate_batch() runs such a predictor over an
+// array of decoded traces in one tight loop, so with the predictor type a
+// template parameter every predict and update call can be inlined.
+// predictor_adapter wraps one in the old branch_predictor interface for
+// code that wants a branch_predictor *, and virtual_simulator goes the
+// other way, running any branch_predictor through the batch interface.
+//
+// A predictor that can also run with delayed updates splits update() in
+// three:
+//
+//	void speculate (const branch_info &, update_type &);
+//	void resolve (const branch_info &, update_type &, bool taken, unsigned int target);
+//	void retire (const branch_info &, update_type &, bool taken, unsigned int target);
+//	int checkpoint_bits (void) const;
+//
+// speculate() advances the speculative state, such as the histories, with
+// the prediction as the branch is fetched, and keeps a checkpoint of it in
+// the update.  resolve() is told the outcome; if the branch was
+// mispredicted it repairs the speculative state from the checkpoint, and
+// it keeps in the update what retire() will need.  retire() trains the
+// tables.  delayed_pipeline keeps a number of branches in flight between
+// resolve() and retire() (see predict -d), retiring the oldest once there
+// are more than that.  The trace holds only the correct path, so a
+// mispredicted branch is resolved before the next branch is fetched, as a
+// real pipeline would after flushing the younger, wrong-path work; the
+// older branches in flight are not flushed and keep waiting to retire.
+// checkpoint_bits() is the speculative state a pipeline would checkpoint
+// per branch for the repair.
+
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+#include "profile.h"
+#include "state.h"
+#include "storage.h"
+
+// how often each component supplied a conditional branch's prediction,
+// and how often it was right
+
+struct provider_counts {
+	long long int used[PROFILE_COMPONENTS], correct[PROFILE_COMPONENTS];
+
+	provider_counts (void) {
+		for (int i = 0; i < PROFILE_COMPONENTS; i++) used[i] = correct[i] = 0;
+	}
+};
+
+// what the driver counts
+
+struct sim_stats {
+	long long int
+		branches,	// traces seen
+		conditional,	// ... of which conditional branches
+		tmiss,		// number of target mispredictions
+		tmiss_indirect,	// ... of which for indirect jumps and calls
+		tmiss_return,	// ... and for returns
+		dmiss,		// number of direction mispredictions
+		repairs;	// delayed pipeline: direction mispredictions repaired
+	branch_profile *profile;	// per-branch counts, if profiling
+	provider_counts *providers;	// per-component counts, if wanted
+
+	sim_stats (void) : branches (0), conditional (0), tmiss (0), tmiss_indirect (0), tmiss_return (0),
+		dmiss (0), repairs (0), profile (NULL), providers (NULL) {}
+};
+
+// the statistics the contest has always kept, for one branch
+
+inline void count_branch (sim_stats &s, const trace &t, branch_update &u) {
+	s.branches++;
+
+	// collect statistics for a conditional branch trace
+
+	if (t.bi.br_flags & BR_CONDITIONAL) {
+
+		// count a direction misprediction
+
+		bool correct = u.direction_prediction () == t.taken;
+		s.conditional++;
+		s.dmiss += !correct;
+
+		// and credit or blame the component that made the prediction
+
+		if (s.providers) {
+			int p = u.provider ();
+			if (p >= 0 && p < PROFILE_COMPONENTS) {
+				s.providers->used[p]++;
+				s.providers->correct[p] += correct;
+			}
+		}
+	}
+
+	// count a target misprediction for any branch that redirects fetch
+
+	if (t.taken && u.target_prediction () != t.target) {
+		s.tmiss++;
+		if (t.bi.br_flags & BR_RETURN) s.tmiss_return++;
+		else if (t.bi.br_flags & BR_INDIRECT) s.tmiss_indirect++;
+	}
+}
+
+// profile a branch once its update is done
+
+inline void profile_branch (sim_stats &s, const trace &t, branch_update &u) {
+	if (s.profile && (t.bi.br_flags & BR_CONDITIONAL)) s.profile->record (t, u);
+}
+
+template <class P>
+void simulate_batch (P &p, const trace *t, size_t n, sim_stats &s) {
+	typename P::update_type u;
+	for (size_t i = 0; i < n; i++) {
+		p.predict (t[i].bi, u);
+		count_branch (s, t[i], u);
+		p.update (t[i].bi, u, t[i].taken, t[i].target);
+		profile_branch (s, t[i], u);
+	}
+}
+
+// whether P has the delayed update
+
+template <class P, class = void>
+struct has_delayed_update : std::false_type {};
+
+template <class P>
+struct has_delayed_update<P, decltype (std::declval<P &> ().retire (std::declval<const branch_info &> (),
+	std::declval<typename P::update_type &> (), false, 0u))> : std::true_type {};
+
+// branches in flight between resolve() and retire(), oldest first, in a
+// ring of depth + 1 slots
+
+template <class P>
+class delayed_pipeline {
+	struct slot {
+		trace t;
+		typename P::update_type u;
+	};
+
+	std::vector<slot> ring;
+	size_t oldest, count;
+
+	void retire_oldest (P &p, sim_stats &s) {
+		slot &x = ring[oldest];
+		p.retire (x.t.bi, x.u, x.t.taken, x.t.target);
+		profile_branch (s, x.t, x.u);
+		oldest = (oldest + 1) % ring.size ();
+		count--;
+	}
+
+public:
+	explicit delayed_pipeline (size_t depth) : ring (depth + 1), oldest (0), count (0) {}
+
+	void run (P &p, const trace *t, size_t n, sim_stats &s) {
+		for (size_t i = 0; i < n; i++) {
+			slot &x = ring[(oldest + count++) % ring.size ()];
+			x.t = t[i];
+			p.predict (x.t.bi, x.u);
+			p.speculate (x.t.bi, x.u);
+			count_branch (s, x.t, x.u);
+
+			// only a wrong direction restores the history; a wrong
+			// target leaves the speculative state as it was
+
+			s.repairs += (x.t.bi.br_flags & BR_CONDITIONAL) && x.u.direction_prediction () != x.t.taken;
+			p.resolve (x.t.bi, x.u, x.t.taken, x.t.target);
+			if (count == ring.size ()) retire_oldest (p, s);
+		}
+	}
+
+	// retire every branch still in flight
+
+	void drain (P &p, sim_stats &s) {
+		while (count) retire_oldest (p, s);
+	}
+};
+
+// the checkpoint calls of both interfaces, for a predictor with the
+// static one
+
+template <class P>
+size_t predictor_state_size (P &p) {
+	state_sizer io;
+	p.serialize (io);
+	return io.size;
+}
+
+template <class P>
+bool save_predictor_state (P &p, FILE *f) {
+	state_writer io (f);
+	p.serialize (io);
+	return io.ok;
+}
+
+template <class P>
+bool load_predictor_state (P &p, FILE *f) {
+	state_reader io (f);
+	p.serialize (io);
+	return io.ok;
+}
+
+// the old interface, for a predictor with the static one
+
+template <class P>
+class predictor_adapter : public branch_predictor {
+	P p;
+	typename P::update_type u;
+	branch_info bi;
+
+public:
+	predictor_adapter (void) {}
+	template <class... A> explicit predictor_adapter (const A &... a) : p (a...) {}
+
+	P &predictor (void) { return p; }
+
+	branch_update *predict (branch_info &b) {
+		bi = b;
+		p.predict (b, u);
+		return &u;
+	}
+
+	void update (branch_update *, bool taken, unsigned int target) {
+		p.update (bi, u, taken, target);
+	}
+
+	size_t state_size (void) { return predictor_state_size (p); }
+	bool save_state (FILE *f) { return save_predictor_state (p, f); }
+	bool load_state (FILE *f) { return load_predictor_state (p, f); }
+};
+
+// runs some predictor over batches of traces; one virtual call per batch
+
+class simulator {
+public:
+	virtual void run (const trace *t, size_t n, sim_stats &s) = 0;
+
+	// keep depth branches in flight between prediction and training
+	// from now on; false if the predictor cannot.  drain() retires the
+	// ones still in flight, before a checkpoint or at the end of the
+	// trace.
+
+	virtual bool delay (size_t) { return false; }
+	virtual void drain (sim_stats &) {}
+	virtual int checkpoint_bits (void) { return 0; }
+
+	// the hardware the predictor models (see storage.h); nothing is
+	// added for a predictor that does not say
+
+	virtual void storage (storage_report &) {}
+
+	// the predictor's state, as for branch_predictor
+
+	virtual size_t state_size (void) = 0;
+	virtual bool save_state (FILE *f) = 0;
+	virtual bool load_state (FILE *f) = 0;
+	virtual ~simulator (void) {}
+};
+
+template <class P>
+class static_simulator : public simulator {
+	P p;
+	delayed_pipeline<P> *pipeline;
+
+public:
+	static_simulator (void) : pipeline (NULL) {}
+	template <class... A> explicit static_simulator (const A &... a) : p (a...), pipeline (NULL) {}
+	~static_simulator (void) { delete pipeline; }
+
+	P &predictor (void) { return p; }
+
+	void run (const trace *t, size_t n, sim_stats &s) {
+		if constexpr (has_delayed_update<P>::value) {
+			if (pipeline) {
+				pipeline->run (p, t, n, s);
+				return;
+			}
+		}
+		simulate_batch (p, t, n, s);
+	}
+
+	bool delay (size_t depth) {
+		if constexpr (has_delayed_update<P>::value) {
+			delete pipeline;
+			pipeline = new delayed_pipeline<P> (depth);
+			return true;
+		}
+		return false;
+	}
+
+	void drain (sim_stats &s) {
+		if constexpr (has_delayed_update<P>::value) {
+			if (pipeline) pipeline->drain (p, s);
+		}
+	}
+
+	int checkpoint_bits (void) {
+		if constexpr (has_delayed_update<P>::value) return p.checkpoint_bits ();
+		return 0;
+	}
+
+	void storage (storage_report &r) { p.storage (r); }
+
+	size_t state_size (void) { return predictor_state_size (p); }
+	bool save_state (FILE *f) { return save_predictor_state (p, f); }
+	bool load_state (FILE *f) { return load_predictor_state (p, f); }
+};
+
+// the compatibility path: any branch_predictor, called virtually per branch
+
+class virtual_simulator : public simulator {
+	branch_predictor *p;
+
+public:
+	explicit virtual_simulator (branch_predictor *bp) : p (bp) {}
+	~virtual_simulator (void) { delete p; }
+
+	size_t state_size (void) { return p->state_size (); }
+	bool save_state (FILE *f) { return p->save_state (f); }
+	bool load_state (FILE *f) { return p->load_state (f); }
+
+	void run (const trace *t, size_t n, sim_stats &s) {
+		for (size_t i = 0; i < n; i++) {
+			branch_info bi = t[i].bi;
+			branch_update *u = p->predict (bi);
+			count_branch (s, t[i], *u);
+			p->update (u, t[i].taken, t[i].target);
+			profile_branch (s, t[i], *u);
+		}
+	}
+};
+
+#endif // SIMULATE_H
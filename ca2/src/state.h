@@ -0,0 +1,69 @@
+// state.h
+// This file declares the visitors that checkpoint a predictor's state.  A
+// predictor with the static interface (see simulate.h) lists its state in
+//
+//	template <class IO> void serialize (IO &io);
+//
+// by calling io.raw () on each table and io.pod () on each scalar or
+// fixed array, and on the serialize () of each part it owns.  The same
+// function then sizes, saves and restores the state, depending on which
+// of the three visitors below it is given, so the three cannot drift
+// apart.  Per-branch scratch (indices computed in predict for update) is
+// left out: checkpoints are taken between branches.
+//
+// The tables are already packed, so the state is written as it lies in
+// memory, with no per-field encoding.
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// counts the bytes a state takes
+
+class state_sizer {
+public:
+	size_t size;
+
+	state_sizer (void) : size (0) {}
+
+	void raw (const void *, size_t n) { size += n; }
+	template <class T> void pod (const T &) { size += sizeof (T); }
+};
+
+// writes a state to a file
+
+class state_writer {
+public:
+	bool ok;
+
+	explicit state_writer (FILE *f) : ok (true), f (f) {}
+
+	void raw (const void *p, size_t n) {
+		if (ok && n && fwrite (p, n, 1, f) != 1) ok = false;
+	}
+	template <class T> void pod (const T &x) { raw (&x, sizeof (T)); }
+
+private:
+	FILE *f;
+};
+
+// reads a state back over a predictor built the same way
+
+class state_reader {
+public:
+	bool ok;
+
+	explicit state_reader (FILE *f) : ok (true), f (f) {}
+
+	void raw (void *p, size_t n) {
+		if (ok && n && fread (p, n, 1, f) != 1) ok = false;
+	}
+	template <class T> void pod (T &x) { raw (&x, sizeof (T)); }
+
+private:
+	FILE *f;
+};
+
+#endif // STATE_H
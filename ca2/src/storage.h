@@ -0,0 +1,128 @@
+// storage.h
+// This file declares storage reports.  A predictor with the static
+// interface (see simulate.h) lists the hardware it models in
+//
+//	void storage (storage_report &r) const;
+//
+// by calling r.add () on each table, register and side component, with
+// the bits the hardware would need rather than the bytes the simulator
+// happens to use: a 3-bit counter the simulator keeps in a byte counts as
+// 3 bits.  Each component keeps its sizes next to its tables (the
+// STORAGE_BITS constants), so a report cannot drift from the code.
+//
+// Each entry is a table, a register (a history, a counter, a threshold)
+// or part of the target subsystem (see target.h).  A budget covers the
+// direction predictor, tables and registers, and leaves out the targets.
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// the CBP budget: 32 KB of tables, and 256 bits more that only registers
+// may use
+
+#define CBP_TABLE_BITS		(32 * 1024 * 8)
+#define CBP_REGISTER_BITS	256
+
+enum storage_kind {
+	STORAGE_TABLE,
+	STORAGE_REGISTER,
+	STORAGE_TARGET
+};
+
+class storage_report {
+public:
+	struct table {
+		std::string name;
+		uint64_t bits;
+		storage_kind kind;
+	};
+
+	std::vector<table> tables;
+
+	void add (const std::string &name, uint64_t bits, storage_kind kind = STORAGE_TABLE) {
+		table t = { name, bits, kind };
+		tables.push_back (t);
+	}
+
+	uint64_t total (void) const {
+		uint64_t bits = 0;
+		for (size_t i = 0; i < tables.size (); i++) bits += tables[i].bits;
+		return bits;
+	}
+
+	uint64_t total (storage_kind kind) const {
+		uint64_t bits = 0;
+		for (size_t i = 0; i < tables.size (); i++)
+			if (tables[i].kind == kind) bits += tables[i].bits;
+		return bits;
+	}
+
+	// the bits a budget covers
+
+	uint64_t direction (void) const {
+		return total (STORAGE_TABLE) + total (STORAGE_REGISTER);
+	}
+
+	// the direction predictor's entries and then the target subsystem's,
+	// each with its subtotal
+
+	void print (FILE *f) const {
+		static const char *const KIND[] = { "", " (register)", "" };
+		for (size_t i = 0; i < tables.size (); i++)
+			if (tables[i].kind != STORAGE_TARGET)
+				fprintf (f, "%-24s %10llu bits%s\n", tables[i].name.c_str (), (unsigned long long) tables[i].bits, KIND[tables[i].kind]);
+		line (f, "direction", direction ());
+		uint64_t targets = total (STORAGE_TARGET);
+		if (targets) {
+			for (size_t i = 0; i < tables.size (); i++)
+				if (tables[i].kind == STORAGE_TARGET)
+					fprintf (f, "%-24s %10llu bits\n", tables[i].name.c_str (), (unsigned long long) tables[i].bits);
+			line (f, "targets", targets);
+		}
+		line (f, "total", total ());
+	}
+
+private:
+	static void line (FILE *f, const char *name, uint64_t bits) {
+		fprintf (f, "%-24s %10llu bits (%0.2f KB)\n", name, (unsigned long long) bits, bits / 8192.0);
+	}
+};
+
+// a budget for the direction predictor: its tables may use table_bits,
+// and its registers those plus register_bits
+
+struct storage_budget {
+	uint64_t table_bits, register_bits;
+
+	bool given (void) const {
+		return table_bits != 0;
+	}
+
+	bool fits (const storage_report &r) const {
+		return r.total (STORAGE_TABLE) <= table_bits && r.direction () <= table_bits + register_bits;
+	}
+};
+
+// a budget given on the command line: a number of bits for tables and
+// registers together, or "cbp".  returns false if s is neither.
+
+inline bool parse_budget (const char *s, storage_budget &budget) {
+	if (strcmp (s, "cbp") == 0) {
+		budget.table_bits = CBP_TABLE_BITS;
+		budget.register_bits = CBP_REGISTER_BITS;
+		return true;
+	}
+	char *end;
+	budget.table_bits = strtoull (s, &end, 0);
+	budget.register_bits = 0;
+	return *s && !*end;
+}
+
+#endif // STORAGE_H
@@ -0,0 +1,540 @@
+// sweep.cc
+// This file contains the design-space exploration tool.  It reads a sweep
+// spec describing ranges of TAGE parameters, runs every (configuration,
+// trace) pair on all cores, and writes a table of configurations ranked by
+// mean MPKI over the traces.
+//
+// Usage: sweep [-j threads] [-b budget] [-m resident] [-s seed] [-o output] spec trace...
+//	-j threads	worker threads (default: one per core)
+//	-b budget	skip configurations whose direction predictor is
+//			over budget bits of storage, or over the CBP budget
+//			if budget is "cbp"; the target subsystem is left out
+//	-m resident	decoded traces to keep in memory at once (default 2)
+//	-s seed		seed for every predictor's random number generators;
+//			each job's predictor owns its generators, so the
+//			table does not depend on the number of threads
+//	-o output	write the results table here instead of stdout
+//
+// A spec is a list of "key value..." lines; '#' starts a comment.
+//	mode grid		run the whole cross product (the default)
+//	mode random N		run N configurations drawn from it at random
+//	seed S			seed for mode random
+//	base name		registered geometry for parameters not swept
+// and then any of these, each taking a list of values (or lo..hi):
+//	index_length bimodal_index_length useful_reset_interval
+//	counter_bits useful_bits loop_predictor statistical_corrector
+//	local_history_index_length local_history_length component_count
+//	min_history max_history	  history lengths are a geometric series
+//	min_tag max_tag		  tag lengths grow linearly
+// If none of the last five keys are given, the base geometry's tag and
+// history lengths are used as they are.
+//
+// Each trace is decompressed and decoded exactly once, into memory, and
+// every configuration runs from that copy.  Traces are decoded in order
+// by the main thread while workers run the jobs of traces already loaded;
+// a trace is freed as soon as its last job finishes.  Jobs are dealt out
+// round-robin to per-worker queues and idle workers steal from the back
+// of other workers' queues.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+#include "simulate.h"
+#include "tage_geometry.h"
+#include "registry.h"
+
+// traces decoded at once
+
+#define DECODE_BATCH	4096
+
+// the swept parameters, in the order they appear in the results table
+
+enum {
+	P_INDEX, P_BIMODAL, P_COMPONENTS, P_MIN_HISTORY, P_MAX_HISTORY,
+	P_MIN_TAG, P_MAX_TAG, P_RESET, P_COUNTER, P_USEFUL, P_LOOP, P_SC,
+	P_LOCAL_INDEX, P_LOCAL_LENGTH, N_PARAMS
+};
+
+static const char *param_names[N_PARAMS] = {
+	"index_length", "bimodal_index_length", "component_count",
+	"min_history", "max_history", "min_tag", "max_tag",
+	"useful_reset_interval", "counter_bits", "useful_bits",
+	"loop_predictor", "statistical_corrector",
+	"local_history_index_length", "local_history_length"
+};
+
+// a parameter's values, kept as the lo..hi ranges the spec gave rather
+// than expanded, so a wide range costs nothing until a value is drawn
+
+struct value_list {
+	struct range {
+		uint32_t lo, hi;
+	};
+	vector<range> ranges;
+
+	uint64_t size (void) const {
+		uint64_t n = 0;
+		for (size_t i = 0; i < ranges.size (); i++) n += (uint64_t) ranges[i].hi - ranges[i].lo + 1;
+		return n;
+	}
+
+	bool empty (void) const { return ranges.empty (); }
+
+	void push_back (uint32_t x) {
+		range r = { x, x };
+		ranges.push_back (r);
+	}
+
+	// the i'th value, counting through the ranges in order
+
+	uint32_t operator[] (uint64_t i) const {
+		for (size_t j = 0; j < ranges.size (); j++) {
+			uint64_t n = (uint64_t) ranges[j].hi - ranges[j].lo + 1;
+			if (i < n) return (uint32_t) (ranges[j].lo + i);
+			i -= n;
+		}
+		return 0;
+	}
+};
+
+struct spec {
+	bool random_mode;
+	int random_count;
+	unsigned int seed;
+	tage_geometry base;
+	bool shape_swept;		// any of the history/tag shape keys given
+	value_list values[N_PARAMS];
+
+	spec (void) : random_mode (false), random_count (0), seed (1), shape_swept (false) {}
+};
+
+// one configuration to evaluate
+
+struct point {
+	uint32_t params[N_PARAMS];
+	tage_geometry g;
+	uint64_t bits;
+	vector<double> mpki;		// one per trace
+	double mean;
+};
+
+// one (configuration, trace) pair
+
+struct job {
+	int point, trace;
+};
+
+// parse a list of values, allowing lo..hi ranges
+
+static bool parse_values (const char *s, value_list &v) {
+	v.ranges.clear ();
+	for (;;) {
+		while (*s == ' ' || *s == '\t' || *s == ',') s++;
+		if (*s == 0 || *s == '\n' || *s == '\r') break;
+		char *end;
+		unsigned long lo = strtoul (s, &end, 0);
+		if (end == s) return false;
+		unsigned long hi = lo;
+		if (end[0] == '.' && end[1] == '.') {
+			s = end + 2;
+			hi = strtoul (s, &end, 0);
+			if (end == s || hi < lo) return false;
+		}
+		if (hi > 0xffffffffUL) return false;
+		value_list::range r = { (uint32_t) lo, (uint32_t) hi };
+		v.ranges.push_back (r);
+		s = end;
+	}
+	return !v.empty ();
+}
+
+static bool read_spec (spec &sp, const char *fname) {
+	FILE *f = fopen (fname, "r");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+	char line[1000];
+	int lineno = 0;
+	bool ok = true;
+	while (ok && fgets (line, sizeof line, f)) {
+		lineno++;
+		char *hash = strchr (line, '#');
+		if (hash) *hash = 0;
+		char key[64];
+		int used;
+		if (sscanf (line, " %63s %n", key, &used) != 1) continue;
+		const char *value = line + used;
+
+		if (strcmp (key, "mode") == 0) {
+			char m[16];
+			int n = 0;
+			int got = sscanf (value, "%15s %d", m, &n);
+			if (got >= 1 && strcmp (m, "grid") == 0) {
+				sp.random_mode = false;
+			} else if (got == 2 && strcmp (m, "random") == 0 && n > 0) {
+				sp.random_mode = true;
+				sp.random_count = n;
+			} else {
+				ok = false;
+			}
+		} else if (strcmp (key, "seed") == 0) {
+			ok = sscanf (value, "%u", &sp.seed) == 1;
+		} else if (strcmp (key, "base") == 0) {
+			char name[64];
+			ok = sscanf (value, "%63s", name) == 1 && lookup_geometry (name, sp.base);
+		} else {
+			int p;
+			for (p = 0; p < N_PARAMS; p++) if (strcmp (key, param_names[p]) == 0) break;
+			ok = p < N_PARAMS && parse_values (value, sp.values[p]);
+			if (ok && (p == P_COMPONENTS || p == P_MIN_HISTORY || p == P_MAX_HISTORY
+			        || p == P_MIN_TAG || p == P_MAX_TAG)) sp.shape_swept = true;
+		}
+		if (!ok) fprintf (stderr, "%s:%d: bad spec line: %s", fname, lineno, line);
+	}
+	fclose (f);
+	return ok;
+}
+
+// fill in default single values for parameters the spec does not sweep
+
+static void default_values (spec &sp) {
+	const tage_geometry &b = sp.base;
+	uint32_t defaults[N_PARAMS] = {
+		b.index_length, b.bimodal_index_length, b.component_count,
+		b.history_length[0], b.history_length[b.component_count - 1],
+		b.tag_length[0], b.tag_length[b.component_count - 1],
+		b.useful_reset_interval, b.counter_bits, b.useful_bits,
+		b.loop_predictor, b.statistical_corrector,
+		b.local_history_index_length, b.local_history_length
+	};
+	for (int p = 0; p < N_PARAMS; p++) {
+		if (sp.values[p].empty ()) sp.values[p].push_back (defaults[p]);
+	}
+}
+
+// build the geometry for one assignment of the parameters
+
+static tage_geometry make_geometry (const spec &sp, const uint32_t *v) {
+	tage_geometry g = sp.base;
+	g.index_length = v[P_INDEX];
+	g.bimodal_index_length = v[P_BIMODAL];
+	g.useful_reset_interval = v[P_RESET];
+	g.counter_bits = v[P_COUNTER];
+	g.useful_bits = v[P_USEFUL];
+	g.loop_predictor = v[P_LOOP];
+	g.statistical_corrector = v[P_SC];
+	g.local_history_index_length = v[P_LOCAL_INDEX];
+	g.local_history_length = v[P_LOCAL_LENGTH];
+	if (!sp.shape_swept) return g;
+
+	uint32_t n = v[P_COMPONENTS];
+	g.component_count = n;
+	for (uint32_t i = 0; i < MAX_COMPONENTS; i++) {
+		g.history_length[i] = 0;
+		g.tag_length[i] = 0;
+	}
+	for (uint32_t i = 0; i < n && i < MAX_COMPONENTS; i++) {
+		double f = n > 1 ? i / (double) (n - 1) : 1.0;
+
+		// geometric history lengths, kept strictly increasing
+
+		uint32_t h = (uint32_t) (v[P_MIN_HISTORY] * pow (v[P_MAX_HISTORY] / (double) v[P_MIN_HISTORY], f) + 0.5);
+		if (i > 0 && h <= g.history_length[i - 1]) h = g.history_length[i - 1] + 1;
+		g.history_length[i] = h;
+		g.tag_length[i] = (uint32_t) (v[P_MIN_TAG] + f * ((double) v[P_MAX_TAG] - v[P_MIN_TAG]) + 0.5);
+	}
+	return g;
+}
+
+// enumerate the configurations the spec asks for, dropping those that are
+// invalid or over budget.  configuration k of the cross product is decoded
+// from k on demand; in random mode distinct k are drawn until there are
+// enough configurations to run or every one has been tried, so neither
+// mode ever lays out the whole cross product.
+
+static vector<point> enumerate_points (const spec &sp, const storage_budget &budget) {
+	uint64_t total = 1;
+	for (int p = 0; p < N_PARAMS; p++) {
+		uint64_t n = sp.values[p].size ();
+		if (total > UINT64_MAX / n) {
+			fprintf (stderr, "the spec has too many configurations to number\n");
+			exit (1);
+		}
+		total *= n;
+	}
+
+	mt19937_64 rng (sp.seed);
+	uniform_int_distribution<uint64_t> draw (0, total - 1);
+	set<uint64_t> tried;
+
+	vector<point> points;
+	int invalid = 0, over = 0;
+	for (uint64_t k = 0; k < total; k++) {
+		if (sp.random_mode && (int) points.size () == sp.random_count) break;
+		uint64_t rest = k;
+		if (sp.random_mode) {
+			do rest = draw (rng); while (!tried.insert (rest).second);
+		}
+		point pt;
+		for (int p = N_PARAMS - 1; p >= 0; p--) {
+			uint64_t n = sp.values[p].size ();
+			pt.params[p] = sp.values[p][rest % n];
+			rest /= n;
+		}
+		pt.g = make_geometry (sp, pt.params);
+		if (check_geometry (pt.g)) {
+			invalid++;
+			continue;
+		}
+		storage_report r;
+		geometry_storage (pt.g, r);
+		pt.bits = r.direction ();
+		if (budget.given () && !budget.fits (r)) {
+			over++;
+			continue;
+		}
+		pt.mean = 0;
+		points.push_back (pt);
+	}
+	fprintf (stderr, "%llu configurations: %d invalid, %d over budget, %d to run\n",
+		(unsigned long long) total, invalid, over, (int) points.size ());
+	return points;
+}
+
+// the state shared between the decoder and the workers
+
+static vector<point> points;
+static vector<string> trace_names;
+static vector<vector<trace> *> loaded;	// decoded traces, NULL when not resident
+static vector<int> remaining;		// unfinished jobs per trace
+static uint32_t predictor_seed = DEFAULT_SEED;
+
+struct work_queue {
+	mutex m;
+	deque<job> jobs;
+};
+
+static vector<work_queue *> queues;
+static mutex state_mutex;
+static condition_variable state_changed;
+static int resident = 0;
+static bool all_dispatched = false;
+static int jobs_done = 0, jobs_total = 0;
+
+// run one configuration over one decoded trace
+
+static double run_job (const tage_geometry &g, const vector<trace> &tr) {
+	simulator *p = make_tage_simulator (g, predictor_seed);
+	sim_stats s;
+	p->run (&tr[0], tr.size (), s);
+	delete p;
+	return 1000.0 * (s.dmiss / 1e8);
+}
+
+static bool take_job (int self, job &j) {
+	int n = queues.size ();
+
+	// our own queue first, oldest job first
+
+	{
+		lock_guard<mutex> l (queues[self]->m);
+		if (!queues[self]->jobs.empty ()) {
+			j = queues[self]->jobs.front ();
+			queues[self]->jobs.pop_front ();
+			return true;
+		}
+	}
+
+	// then steal the newest job from someone else
+
+	for (int k = 1; k < n; k++) {
+		work_queue *q = queues[(self + k) % n];
+		lock_guard<mutex> l (q->m);
+		if (!q->jobs.empty ()) {
+			j = q->jobs.back ();
+			q->jobs.pop_back ();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void worker (int self) {
+	for (;;) {
+		job j;
+		if (!take_job (self, j)) {
+			unique_lock<mutex> l (state_mutex);
+			if (all_dispatched && jobs_done == jobs_total) return;
+			state_changed.wait_for (l, chrono::milliseconds (10));
+			continue;
+		}
+		double mpki = run_job (points[j.point].g, *loaded[j.trace]);
+
+		lock_guard<mutex> l (state_mutex);
+		points[j.point].mpki[j.trace] = mpki;
+		jobs_done++;
+		if (--remaining[j.trace] == 0) {
+			delete loaded[j.trace];
+			loaded[j.trace] = NULL;
+			resident--;
+		}
+		state_changed.notify_all ();
+	}
+}
+
+// decode a whole trace into memory
+
+static vector<trace> *decode (const char *fname) {
+	vector<trace> *v = new vector<trace>;
+	init_trace ((char *) fname);
+	for (;;) {
+		size_t n = v->size ();
+		v->resize (n + DECODE_BATCH);
+		size_t k = read_traces (&(*v)[n], DECODE_BATCH);
+		v->resize (n + k);
+		if (k == 0) break;
+	}
+	end_trace ();
+	return v;
+}
+
+static string short_name (const char *path) {
+	const char *s = strrchr (path, '/');
+	s = s ? s + 1 : path;
+	const char *dot = strchr (s, '.');
+	return dot ? string (s, dot - s) : string (s);
+}
+
+static bool by_mean (const point &a, const point &b) {
+	return a.mean < b.mean;
+}
+
+static void write_results (FILE *f) {
+	fprintf (f, "rank\tmean_mpki\tbits");
+	for (int p = 0; p < N_PARAMS; p++) fprintf (f, "\t%s", param_names[p]);
+	fprintf (f, "\ttag_length\thistory_length");
+	for (size_t t = 0; t < trace_names.size (); t++) fprintf (f, "\t%s", trace_names[t].c_str ());
+	fprintf (f, "\n");
+	for (size_t i = 0; i < points.size (); i++) {
+		const point &pt = points[i];
+		fprintf (f, "%d\t%0.3f\t%llu", (int) i + 1, pt.mean, (unsigned long long) pt.bits);
+		for (int p = 0; p < N_PARAMS; p++) fprintf (f, "\t%u", pt.params[p]);
+		for (int list = 0; list < 2; list++) {
+			const uint32_t *v = list ? pt.g.history_length : pt.g.tag_length;
+			fprintf (f, "\t");
+			for (uint32_t c = 0; c < pt.g.component_count; c++) fprintf (f, "%s%u", c ? "," : "", v[c]);
+		}
+		for (size_t t = 0; t < pt.mpki.size (); t++) fprintf (f, "\t%0.3f", pt.mpki[t]);
+		fprintf (f, "\n");
+	}
+}
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-j threads] [-b budget] [-m resident] [-s seed] [-o output] spec trace...\n", prog);
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	int nthreads = thread::hardware_concurrency ();
+	int max_resident = 2;
+	storage_budget budget = { 0, 0 };
+	const char *output = NULL;
+	int c;
+
+	while ((c = getopt (argc, argv, "j:b:m:s:o:")) != -1) {
+		switch (c) {
+		case 'j': nthreads = atoi (optarg); break;
+		case 'b':
+			if (!parse_budget (optarg, budget)) usage (argv[0]);
+			break;
+		case 'm': max_resident = atoi (optarg); break;
+		case 's': predictor_seed = strtoul (optarg, NULL, 0); break;
+		case 'o': output = optarg; break;
+		default: usage (argv[0]);
+		}
+	}
+	if (argc - optind < 2) usage (argv[0]);
+	if (nthreads < 1) nthreads = 1;
+	if (max_resident < 1) max_resident = 1;
+
+	spec sp;
+	if (!read_spec (sp, argv[optind])) exit (1);
+	default_values (sp);
+	points = enumerate_points (sp, budget);
+	if (points.empty ()) exit (1);
+
+	int ntraces = argc - optind - 1;
+	for (int t = 0; t < ntraces; t++) trace_names.push_back (short_name (argv[optind + 1 + t]));
+	for (size_t i = 0; i < points.size (); i++) points[i].mpki.assign (ntraces, 0.0);
+	loaded.assign (ntraces, NULL);
+	remaining.assign (ntraces, points.size ());
+	jobs_total = ntraces * points.size ();
+
+	for (int i = 0; i < nthreads; i++) queues.push_back (new work_queue);
+	vector<thread> workers;
+	for (int i = 0; i < nthreads; i++) workers.push_back (thread (worker, i));
+
+	// decode the traces in order, dealing out each one's jobs as it
+	// arrives, but never holding more than max_resident in memory
+
+	int next_queue = 0;
+	for (int t = 0; t < ntraces; t++) {
+		{
+			unique_lock<mutex> l (state_mutex);
+			while (resident >= max_resident) state_changed.wait (l);
+			resident++;
+		}
+		fprintf (stderr, "decoding %s (%d/%d jobs done)\n", argv[optind + 1 + t], jobs_done, jobs_total);
+		vector<trace> *v = decode (argv[optind + 1 + t]);
+		lock_guard<mutex> l (state_mutex);
+		loaded[t] = v;
+		for (size_t i = 0; i < points.size (); i++) {
+			job j = { (int) i, t };
+			lock_guard<mutex> ql (queues[next_queue]->m);
+			queues[next_queue]->jobs.push_back (j);
+			next_queue = (next_queue + 1) % nthreads;
+		}
+		state_changed.notify_all ();
+	}
+	{
+		lock_guard<mutex> l (state_mutex);
+		all_dispatched = true;
+		state_changed.notify_all ();
+	}
+	for (int i = 0; i < nthreads; i++) workers[i].join ();
+
+	// rank by mean MPKI
+
+	for (size_t i = 0; i < points.size (); i++) {
+		double sum = 0;
+		for (int t = 0; t < ntraces; t++) sum += points[i].mpki[t];
+		points[i].mean = sum / ntraces;
+	}
+	stable_sort (points.begin (), points.end (), by_mean);
+
+	FILE *f = output ? fopen (output, "w") : stdout;
+	if (!f) {
+		perror (output);
+		exit (1);
+	}
+	write_results (f);
+	if (output) fclose (f);
+	exit (0);
+}
@@ -0,0 +1,245 @@
+// tage_geometry.cc
+// This file contains code for checking, reading and printing TAGE
+// geometries.  A geometry config file is a list of lines of the form
+//
+//	key value...
+//
+// where '#' starts a comment.  The keys are the field names of
+// tage_geometry; tag_length and history_length take one value per tagged
+// component and set component_count.  The key "base" takes the name of a
+// registered geometry and copies it, so a file can describe a design point
+// as a few changes to a known one.  loop_predictor and statistical_corrector
+// take 0 or 1 and switch those side components off or on.
+// local_history_length gives the corrector a local history of that many
+// bits per branch, in 2^local_history_index_length registers, or none if 0.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tage_geometry.h"
+#include "registry.h"
+#include "loop.h"
+#include "corrector.h"
+#include "local.h"
+#include "target.h"
+
+tage_geometry::tage_geometry (void) {
+	geometry_default d;
+	index_length = d.index_length;
+	bimodal_index_length = d.bimodal_index_length;
+	component_count = d.component_count;
+	for (uint32_t i = 0; i < MAX_COMPONENTS; i++) {
+		tag_length[i] = i < d.component_count ? d.tag_length[i] : 0;
+		history_length[i] = i < d.component_count ? d.history_length[i] : 0;
+	}
+	useful_reset_interval = d.useful_reset_interval;
+	counter_bits = d.counter_bits;
+	useful_bits = d.useful_bits;
+	loop_predictor = d.loop_predictor;
+	statistical_corrector = d.statistical_corrector;
+	local_history_index_length = d.local_history_index_length;
+	local_history_length = d.local_history_length;
+}
+
+bool same_geometry (const tage_geometry &a, const tage_geometry &b) {
+	if (a.index_length != b.index_length
+	 || a.bimodal_index_length != b.bimodal_index_length
+	 || a.component_count != b.component_count
+	 || a.useful_reset_interval != b.useful_reset_interval
+	 || a.counter_bits != b.counter_bits
+	 || a.useful_bits != b.useful_bits
+	 || a.loop_predictor != b.loop_predictor
+	 || a.statistical_corrector != b.statistical_corrector
+	 || a.local_history_index_length != b.local_history_index_length
+	 || a.local_history_length != b.local_history_length) return false;
+	for (uint32_t i = 0; i < a.component_count; i++) {
+		if (a.tag_length[i] != b.tag_length[i]
+		 || a.history_length[i] != b.history_length[i]) return false;
+	}
+	return true;
+}
+
+const char *check_geometry (const tage_geometry &g) {
+	if (g.index_length < 1 || g.index_length > 16)
+		return "index_length must be between 1 and 16";
+	if (g.bimodal_index_length < 2 || g.bimodal_index_length > 16)
+		return "bimodal_index_length must be between 2 and 16";
+	if (g.component_count < 1 || g.component_count > MAX_COMPONENTS)
+		return "there must be between 1 and 16 tagged components";
+
+	// the index hash shifts the pc right by index_length - component + 1
+
+	if (g.component_count > g.index_length)
+		return "component_count may not exceed index_length";
+	for (uint32_t i = 0; i < g.component_count; i++) {
+		if (g.tag_length[i] < 1 || g.tag_length[i] > 16)
+			return "tag lengths must be between 1 and 16";
+		if (g.history_length[i] < 1)
+			return "history lengths must be positive";
+		if (i > 0 && g.history_length[i] <= g.history_length[i - 1])
+			return "history lengths must be increasing";
+	}
+	if (g.counter_bits < 2 || g.counter_bits > 7)
+		return "counter_bits must be between 2 and 7";
+	if (g.useful_bits < 1 || g.useful_bits > 7)
+		return "useful_bits must be between 1 and 7";
+
+	// an entry's two counters share a byte
+
+	if (g.counter_bits + g.useful_bits > 8)
+		return "counter_bits + useful_bits may not exceed 8";
+	if (g.useful_reset_interval < 1)
+		return "useful_reset_interval must be positive";
+	if (g.loop_predictor > 1 || g.statistical_corrector > 1)
+		return "loop_predictor and statistical_corrector must be 0 or 1";
+
+	// only the corrector reads the local history
+
+	if (g.local_history_length) {
+		if (g.local_history_length > (uint32_t) local_history::MAX_LENGTH)
+			return "local_history_length must be at most 32";
+		if (g.local_history_index_length < 1 || g.local_history_index_length > 16)
+			return "local_history_index_length must be between 1 and 16";
+		if (!g.statistical_corrector)
+			return "local_history_length needs the statistical_corrector";
+	}
+	return NULL;
+}
+
+// read up to MAX_COMPONENTS unsigned integers from s into v
+
+static int read_list (const char *s, uint32_t *v) {
+	int n = 0;
+	for (;;) {
+		char *end;
+		unsigned long x = strtoul (s, &end, 0);
+		if (end == s) break;
+		if (n == (int) MAX_COMPONENTS) return -1;
+		v[n++] = (uint32_t) x;
+		s = end;
+		while (*s == ',' || *s == ' ' || *s == '\t') s++;
+	}
+	return n;
+}
+
+bool set_geometry_field (tage_geometry &g, const char *line) {
+	char key[64];
+	int used;
+	if (sscanf (line, " %63s %n", key, &used) != 1) return false;
+	const char *value = line + used;
+	uint32_t v[MAX_COMPONENTS];
+	int n = read_list (value, v);
+
+	if (strcmp (key, "base") == 0) {
+		char name[64];
+		if (sscanf (value, "%63s", name) != 1) return false;
+		return lookup_geometry (name, g);
+	}
+	if (strcmp (key, "tag_length") == 0 || strcmp (key, "history_length") == 0) {
+		if (n <= 0) return false;
+		uint32_t *dst = key[0] == 't' ? g.tag_length : g.history_length;
+		for (int i = 0; i < (int) MAX_COMPONENTS; i++) dst[i] = i < n ? v[i] : 0;
+		g.component_count = n;
+		return true;
+	}
+	if (n != 1) return false;
+	if (strcmp (key, "index_length") == 0) g.index_length = v[0];
+	else if (strcmp (key, "bimodal_index_length") == 0) g.bimodal_index_length = v[0];
+	else if (strcmp (key, "useful_reset_interval") == 0) g.useful_reset_interval = v[0];
+	else if (strcmp (key, "counter_bits") == 0) g.counter_bits = v[0];
+	else if (strcmp (key, "useful_bits") == 0) g.useful_bits = v[0];
+	else if (strcmp (key, "loop_predictor") == 0) g.loop_predictor = v[0];
+	else if (strcmp (key, "statistical_corrector") == 0) g.statistical_corrector = v[0];
+	else if (strcmp (key, "local_history_index_length") == 0) g.local_history_index_length = v[0];
+	else if (strcmp (key, "local_history_length") == 0) g.local_history_length = v[0];
+	else return false;
+	return true;
+}
+
+bool read_geometry_file (tage_geometry &g, const char *fname) {
+	FILE *f = fopen (fname, "r");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+	char line[1000];
+	int lineno = 0;
+	bool ok = true;
+	while (ok && fgets (line, sizeof line, f)) {
+		lineno++;
+
+		// strip comments and skip blank lines
+
+		char *hash = strchr (line, '#');
+		if (hash) *hash = 0;
+		if (strspn (line, " \t\r\n") == strlen (line)) continue;
+		if (!set_geometry_field (g, line)) {
+			fprintf (stderr, "%s:%d: bad geometry line: %s", fname, lineno, line);
+			ok = false;
+		}
+	}
+	fclose (f);
+
+	// the list keys each set component_count; they had better agree
+
+	for (uint32_t i = 0; ok && i < MAX_COMPONENTS; i++) {
+		if ((g.tag_length[i] == 0) != (g.history_length[i] == 0)) {
+			fprintf (stderr, "%s: tag_length and history_length have different lengths\n", fname);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+void print_geometry (FILE *f, const tage_geometry &g) {
+	fprintf (f, "index_length %u\n", g.index_length);
+	fprintf (f, "bimodal_index_length %u\n", g.bimodal_index_length);
+	fprintf (f, "tag_length");
+	for (uint32_t i = 0; i < g.component_count; i++) fprintf (f, " %u", g.tag_length[i]);
+	fprintf (f, "\nhistory_length");
+	for (uint32_t i = 0; i < g.component_count; i++) fprintf (f, " %u", g.history_length[i]);
+	fprintf (f, "\nuseful_reset_interval %u\n", g.useful_reset_interval);
+	fprintf (f, "counter_bits %u\n", g.counter_bits);
+	fprintf (f, "useful_bits %u\n", g.useful_bits);
+	fprintf (f, "loop_predictor %u\n", g.loop_predictor);
+	fprintf (f, "statistical_corrector %u\n", g.statistical_corrector);
+	fprintf (f, "local_history_index_length %u\n", g.local_history_index_length);
+	fprintf (f, "local_history_length %u\n", g.local_history_length);
+}
+
+void tage_storage (const tage_geometry &g, storage_report &r) {
+	r.add ("bimodal", (uint64_t) 2 << g.bimodal_index_length);
+	for (uint32_t i = 0; i < g.component_count; i++) {
+		char name[32];
+		uint64_t entry = g.counter_bits + g.useful_bits + g.tag_length[i];
+		snprintf (name, sizeof name, "tagged %u", i + 1);
+		r.add (name, entry << g.index_length);
+	}
+
+	// use_alt_on_na and the useful reset counter
+
+	r.add ("use_alt_on_na", 4, STORAGE_REGISTER);
+	uint64_t bits = 0;
+	uint32_t interval = g.useful_reset_interval;
+	while (interval) {
+		bits++;
+		interval >>= 1;
+	}
+	r.add ("useful reset counter", bits, STORAGE_REGISTER);
+}
+
+void geometry_storage (const tage_geometry &g, storage_report &r) {
+	tage_storage (g, r);
+	r.add ("global history", max_history_length (g), STORAGE_REGISTER);
+
+	// the side components, if present, and the target subsystem
+
+	if (g.loop_predictor) r.add ("loop predictor", loop_predictor::STORAGE_BITS);
+	if (g.statistical_corrector) r.add ("statistical corrector", statistical_corrector::STORAGE_BITS);
+	if (g.local_history_length) {
+		r.add ("local history", (uint64_t) g.local_history_length << g.local_history_index_length);
+		r.add ("corrector local tables", statistical_corrector::LOCAL_STORAGE_BITS);
+	}
+	target_predictor::storage (r);
+}
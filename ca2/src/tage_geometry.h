@@ -0,0 +1,179 @@
+// tage_geometry.h
+// This file declares the TAGE geometry descriptions.  A geometry is the set
+// of sizes that shape a TAGE predictor: how many tagged components there
+// are, how they are indexed and tagged, and how much history each uses.
+//
+// There are two kinds of geometry.  A static geometry is a struct whose
+// fields are all compile-time constants, so a Tage instantiated on it gets
+// every mask, shift and loop bound constant-folded.  tage_geometry has the
+// same fields as ordinary members and is what config files and the command
+// line produce; a Tage instantiated on it is the generic fallback for
+// design points that have no specialized kernel.
+
+#ifndef TAGE_GEOMETRY_H
+#define TAGE_GEOMETRY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "storage.h"
+
+// upper bound on tagged components for any geometry
+
+static const uint32_t MAX_COMPONENTS = 16;
+
+// the runtime geometry
+
+struct tage_geometry {
+	uint32_t index_length;		// log2 of entries per tagged component
+	uint32_t bimodal_index_length;	// log2 of entries in the bimodal base
+	uint32_t component_count;	// number of tagged components
+	uint32_t tag_length[MAX_COMPONENTS];
+	uint32_t history_length[MAX_COMPONENTS];
+	uint32_t useful_reset_interval;	// branches between useful decays
+	uint32_t counter_bits;		// width of the prediction counters
+	uint32_t useful_bits;		// width of the useful counters
+	uint32_t loop_predictor;	// 1 = add the loop predictor (loop.h)
+	uint32_t statistical_corrector;	// 1 = add the corrector (corrector.h)
+	uint32_t local_history_index_length;	// log2 of local history registers
+	uint32_t local_history_length;	// bits per register; 0 = no local history
+
+	tage_geometry (void);
+};
+
+// the geometry my_predictor has always used
+
+struct geometry_default {
+	static const uint32_t index_length = 9;
+	static const uint32_t bimodal_index_length = 12;
+	static const uint32_t component_count = 7;
+	static constexpr uint32_t tag_length[MAX_COMPONENTS] = {9, 9, 10, 10, 11, 11, 12};
+	static constexpr uint32_t history_length[MAX_COMPONENTS] = {5, 9, 15, 25, 44, 76, 130};
+	static const uint32_t useful_reset_interval = 256000;
+	static const uint32_t counter_bits = 3;
+	static const uint32_t useful_bits = 2;
+	static const uint32_t loop_predictor = 0;
+	static const uint32_t statistical_corrector = 0;
+	static const uint32_t local_history_index_length = 0;
+	static const uint32_t local_history_length = 0;
+};
+
+// the default geometry with the loop predictor and statistical corrector
+
+struct geometry_default_scl : geometry_default {
+	static const uint32_t loop_predictor = 1;
+	static const uint32_t statistical_corrector = 1;
+};
+
+// default-scl with a local history for the corrector, as in TAGE-SC-L
+
+struct geometry_default_local : geometry_default_scl {
+	static const uint32_t local_history_index_length = 8;
+	static const uint32_t local_history_length = 11;
+};
+
+// a smaller, shorter-history geometry
+
+struct geometry_small {
+	static const uint32_t index_length = 8;
+	static const uint32_t bimodal_index_length = 11;
+	static const uint32_t component_count = 4;
+	static constexpr uint32_t tag_length[MAX_COMPONENTS] = {8, 9, 10, 11};
+	static constexpr uint32_t history_length[MAX_COMPONENTS] = {5, 15, 44, 130};
+	static const uint32_t useful_reset_interval = 256000;
+	static const uint32_t counter_bits = 3;
+	static const uint32_t useful_bits = 2;
+	static const uint32_t loop_predictor = 0;
+	static const uint32_t statistical_corrector = 0;
+	static const uint32_t local_history_index_length = 0;
+	static const uint32_t local_history_length = 0;
+};
+
+// a larger geometry with longer histories
+
+struct geometry_large {
+	static const uint32_t index_length = 10;
+	static const uint32_t bimodal_index_length = 13;
+	static const uint32_t component_count = 9;
+	static constexpr uint32_t tag_length[MAX_COMPONENTS] = {8, 9, 10, 10, 11, 11, 12, 12, 13};
+	static constexpr uint32_t history_length[MAX_COMPONENTS] = {4, 7, 12, 20, 34, 58, 98, 167, 284};
+	static const uint32_t useful_reset_interval = 512000;
+	static const uint32_t counter_bits = 3;
+	static const uint32_t useful_bits = 2;
+	static const uint32_t loop_predictor = 0;
+	static const uint32_t statistical_corrector = 0;
+	static const uint32_t local_history_index_length = 0;
+	static const uint32_t local_history_length = 0;
+};
+
+// copy any geometry, static or runtime, into a tage_geometry
+
+template <class G>
+tage_geometry describe_geometry (const G &g) {
+	tage_geometry out;
+	out.index_length = g.index_length;
+	out.bimodal_index_length = g.bimodal_index_length;
+	out.component_count = g.component_count;
+	for (uint32_t i = 0; i < MAX_COMPONENTS; i++) {
+		out.tag_length[i] = i < g.component_count ? g.tag_length[i] : 0;
+		out.history_length[i] = i < g.component_count ? g.history_length[i] : 0;
+	}
+	out.useful_reset_interval = g.useful_reset_interval;
+	out.counter_bits = g.counter_bits;
+	out.useful_bits = g.useful_bits;
+	out.loop_predictor = g.loop_predictor;
+	out.statistical_corrector = g.statistical_corrector;
+	out.local_history_index_length = g.local_history_index_length;
+	out.local_history_length = g.local_history_length;
+	return out;
+}
+
+// longest history any component of g uses
+
+template <class G>
+constexpr uint32_t max_history_length (const G &g) {
+	uint32_t m = 0;
+	for (uint32_t i = 0; i < g.component_count; i++) {
+		if (g.history_length[i] > m) m = g.history_length[i];
+	}
+	return m;
+}
+
+// longest tag any component of g uses
+
+template <class G>
+constexpr uint32_t max_tag_length (const G &g) {
+	uint32_t m = 0;
+	for (uint32_t i = 0; i < g.component_count; i++) {
+		if (g.tag_length[i] > m) m = g.tag_length[i];
+	}
+	return m;
+}
+
+bool same_geometry (const tage_geometry &, const tage_geometry &);
+
+// returns NULL if g is usable, otherwise a description of what is wrong
+
+const char *check_geometry (const tage_geometry &g);
+
+// apply one "key value..." line to g; returns false on a bad line
+
+bool set_geometry_field (tage_geometry &g, const char *line);
+
+// read a config file of "key value..." lines into g, which should already
+// hold the starting geometry.  returns false and prints a message on error.
+
+bool read_geometry_file (tage_geometry &g, const char *fname);
+
+void print_geometry (FILE *f, const tage_geometry &g);
+
+// the hardware storage a TAGE predictor of geometry g models, table by
+// table: TAGE's tables, history and counters, the side components it
+// asks for and, as its own section, the target subsystem.  tage_storage
+// is TAGE's tables and counters alone.
+
+void tage_storage (const tage_geometry &g, storage_report &r);
+
+void geometry_storage (const tage_geometry &g, storage_report &r);
+
+#endif // TAGE_GEOMETRY_H
@@ -0,0 +1,358 @@
+// target.h
+// This file declares the target prediction subsystem: a set-associative
+// branch target buffer for direct branches, a return address stack for
+// returns, and an ITTAGE-style predictor for indirect jumps and calls.
+//
+// The indirect predictor does not keep a direction history of its own.  It
+// folds the global history of the direction predictor it is paired with,
+// through any History type that provides
+//
+//	uint32_t foldHistory (int length, int width) const;
+//	int historyLength (void) const;
+//
+// and adds a short path history of recent indirect targets.  Given a
+// global_history (see history.h), track() asks it to keep the folds the
+// indirect predictor reads up to date.
+
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+using namespace std;
+
+#include "branch.h"
+#include "storage.h"
+#include "xorshift.h"
+
+// a set-associative BTB with 2-bit LRU ages and partial tags
+
+class btb {
+public:
+	static const uint32_t SET_INDEX_LENGTH = 9;
+	static const uint32_t SETS = 1 << SET_INDEX_LENGTH;
+	static const uint32_t WAYS = 4;
+	static const uint32_t TAG_LENGTH = 16;
+
+	// modeled bits: per entry target, tag, age and valid
+	static const uint64_t STORAGE_BITS = (uint64_t) SETS * WAYS * (32 + TAG_LENGTH + 2 + 1);
+
+	btb(void) {
+		memset(entries, 0, sizeof entries);
+		for (uint32_t s = 0; s < SETS; s++) {
+			for (uint32_t w = 0; w < WAYS; w++) {
+				entries[s][w].age = w;
+			}
+		}
+	}
+
+	// the remembered target of pc, or 0 on a miss
+
+	uint32_t lookup(uint32_t pc) const {
+		const entry *set = entries[setOf(pc)];
+		for (uint32_t w = 0; w < WAYS; w++) {
+			if (set[w].valid && set[w].tag == tagOf(pc)) {
+				return set[w].target;
+			}
+		}
+		return 0;
+	}
+
+	void update(uint32_t pc, uint32_t target) {
+		entry *set = entries[setOf(pc)];
+		uint32_t way = WAYS;
+		for (uint32_t w = 0; w < WAYS; w++) {
+			if (set[w].valid && set[w].tag == tagOf(pc)) {
+				way = w;
+			}
+		}
+
+		// replace the least recently used way on a miss
+		if (way == WAYS) {
+			for (uint32_t w = 0; w < WAYS; w++) {
+				if (set[w].age == WAYS - 1) {
+					way = w;
+				}
+			}
+			set[way].valid = true;
+			set[way].tag = tagOf(pc);
+		}
+		set[way].target = target;
+		touch(set, way);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(entries);
+	}
+
+private:
+	struct entry {
+		uint32_t target;
+		uint16_t tag;
+		uint8_t age; // 0 = most recently used
+		bool valid;
+	};
+
+	entry entries[SETS][WAYS];
+
+	static uint32_t setOf(uint32_t pc) {
+		return pc & (SETS - 1);
+	}
+
+	static uint16_t tagOf(uint32_t pc) {
+		return (pc >> SET_INDEX_LENGTH) & ((1 << TAG_LENGTH) - 1);
+	}
+
+	static void touch(entry *set, uint32_t way) {
+		for (uint32_t w = 0; w < WAYS; w++) {
+			if (set[w].age < set[way].age) {
+				set[w].age++;
+			}
+		}
+		set[way].age = 0;
+	}
+};
+
+// a circular return address stack.  the trace does not give instruction
+// lengths, so the stack learns each call site's length the first time one
+// of its returns resolves; until then it guesses the usual x86 lengths.
+
+class return_stack {
+public:
+	static const uint32_t DEPTH = 32;
+	static const uint32_t LENGTH_INDEX_LENGTH = 10;
+	static const uint32_t LENGTH_SIZE = 1 << LENGTH_INDEX_LENGTH;
+
+	// modeled bits: the call and return address per entry, the 5-bit
+	// top and the 4-bit learned call lengths
+	static const uint64_t STORAGE_BITS = (uint64_t) DEPTH * 64 + 5 + LENGTH_SIZE * 4;
+
+	return_stack(void) : top(0) {
+		memset(stack, 0, sizeof stack);
+		memset(call_length, 0, sizeof call_length);
+	}
+
+	void push(const branch_info &b) {
+		uint8_t length = call_length[b.address & (LENGTH_SIZE - 1)];
+		if (length == 0) {
+			length = (b.br_flags & BR_INDIRECT) ? 2 : 5;
+		}
+		top = (top + 1) % DEPTH;
+		stack[top].call = b.address;
+		stack[top].ret = b.address + length;
+	}
+
+	uint32_t peek(void) const {
+		return stack[top].ret;
+	}
+
+	// pop the stack for a return that went to target
+	void pop(uint32_t target) {
+		uint32_t length = target - stack[top].call;
+		if (target != stack[top].ret && length >= 1 && length <= 15) {
+			call_length[stack[top].call & (LENGTH_SIZE - 1)] = length;
+		}
+		top = (top + DEPTH - 1) % DEPTH;
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(stack);
+		io.pod(top);
+		io.pod(call_length);
+	}
+
+private:
+	struct entry {
+		uint32_t call, ret;
+	};
+
+	entry stack[DEPTH];
+	uint32_t top;
+	uint8_t call_length[LENGTH_SIZE]; // 4 bit learned call lengths, 0 = unknown
+};
+
+// an ITTAGE-style indirect target predictor.  the base prediction is the
+// BTB's; tagged components indexed with increasing history lengths override
+// it, the longest matching one providing the target.
+
+class ittage {
+public:
+	static constexpr int COMPONENT_COUNT = 5;
+	static const uint32_t INDEX_LENGTH = 8;
+	static const uint32_t COMPONENT_SIZE = 1 << INDEX_LENGTH;
+	static const uint32_t TAG_LENGTH = 11;
+
+	// modeled bits: per entry target, tag, confidence and useful; plus
+	// the path history
+	static const uint64_t STORAGE_BITS = (uint64_t) COMPONENT_COUNT * COMPONENT_SIZE * (32 + TAG_LENGTH + 2 + 1) + 32;
+
+	explicit ittage(uint32_t seed = DEFAULT_SEED) : provider(0), path(0), rng(seed, STREAM_ITTAGE) {
+		memset(entries, 0, sizeof entries);
+	}
+
+	template <class History>
+	uint32_t predict(uint32_t pc, uint32_t base_target, const History &h) {
+		for (int i = 0; i < COMPONENT_COUNT; i++) {
+			int length = min(HISTORY_LENGTH[i], h.historyLength());
+			uint32_t folded = h.foldHistory(length, INDEX_LENGTH) ^ (h.foldHistory(length, TAG_LENGTH) << 1);
+			uint32_t p = path & ((1u << min(2 * (i + 1), 16)) - 1);
+			index[i] = (pc ^ (pc >> (INDEX_LENGTH - i)) ^ folded ^ p) & (COMPONENT_SIZE - 1);
+			tag[i] = (pc ^ (pc >> 3) ^ h.foldHistory(length, TAG_LENGTH) ^ (p << 2)) & ((1 << TAG_LENGTH) - 1);
+		}
+		provider = 0;
+		for (int i = COMPONENT_COUNT; i >= 1; i--) {
+			if (entryFor(i).tag == tag[i - 1] && entryFor(i).target) {
+				provider = i;
+				break;
+			}
+		}
+		return provider ? entryFor(provider).target : base_target;
+	}
+
+	template <class History>
+	void track(History &h) {
+		for (int i = 0; i < COMPONENT_COUNT; i++) {
+			int length = min(HISTORY_LENGTH[i], h.historyLength());
+			h.track(length, INDEX_LENGTH);
+			h.track(length, TAG_LENGTH);
+		}
+	}
+
+	// the component that supplied the last prediction; 0 is the BTB
+
+	int lastProvider(void) const {
+		return provider;
+	}
+
+	void update(uint32_t predicted, uint32_t target) {
+		bool correct = predicted == target;
+		if (provider) {
+			entry &e = entryFor(provider);
+			if (e.target == target) {
+				if (e.confidence < 3) e.confidence++;
+				e.useful = 1;
+			} else if (e.confidence > 0) {
+				e.confidence--;
+			} else {
+				e.target = target;
+			}
+		}
+
+		// allocate one longer component on a misprediction
+		if (!correct && provider < COMPONENT_COUNT) {
+			int start = provider + 1 + (rng.next() & 1);
+			bool done = false;
+			for (int i = min(start, COMPONENT_COUNT); i <= COMPONENT_COUNT && !done; i++) {
+				entry &e = entryFor(i);
+				if (e.useful == 0) {
+					e.tag = tag[i - 1];
+					e.target = target;
+					e.confidence = 0;
+					done = true;
+				}
+			}
+			if (!done) {
+				for (int i = provider + 1; i <= COMPONENT_COUNT; i++) {
+					entryFor(i).useful = 0;
+				}
+			}
+		}
+		path = (path << 2) ^ (target >> 2);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(entries);
+		io.pod(path);
+		rng.serialize(io);
+	}
+
+private:
+	static constexpr int HISTORY_LENGTH[COMPONENT_COUNT] = {4, 10, 24, 56, 128};
+
+	struct entry {
+		uint32_t target;
+		uint16_t tag;
+		uint8_t confidence; // 2 bits
+		uint8_t useful; // 1 bit
+	};
+
+	entry entries[COMPONENT_COUNT][COMPONENT_SIZE];
+	uint32_t index[COMPONENT_COUNT];
+	uint16_t tag[COMPONENT_COUNT];
+	int provider;
+	uint32_t path; // recent indirect targets
+	xorshift rng;
+
+	entry &entryFor(int component) {
+		return entries[component - 1][index[component - 1]];
+	}
+};
+
+// the whole subsystem: which structure predicts a branch depends on its kind
+
+class target_predictor {
+public:
+	explicit target_predictor(uint32_t seed = DEFAULT_SEED) : indirect(seed), predicted(0) {
+	}
+
+	template <class History>
+	uint32_t predict(const branch_info &b, const History &h) {
+		if (b.br_flags & BR_RETURN) {
+			predicted = ras.peek();
+		} else if (b.br_flags & BR_INDIRECT) {
+			predicted = indirect.predict(b.address, targets.lookup(b.address), h);
+		} else {
+			predicted = targets.lookup(b.address);
+		}
+		return predicted;
+	}
+
+	template <class History>
+	void track(History &h) {
+		indirect.track(h);
+	}
+
+	// call before the direction predictor updates its history, so the
+	// indirect predictor sees the same history it predicted with
+
+	void update(const branch_info &b, bool taken, uint32_t target) {
+		if (b.br_flags & BR_RETURN) {
+			ras.pop(target);
+		} else {
+			if (b.br_flags & BR_INDIRECT) {
+				indirect.update(predicted, target);
+			}
+			if (taken) {
+				targets.update(b.address, target);
+			}
+			if (b.br_flags & BR_CALL) {
+				ras.push(b);
+			}
+		}
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		targets.serialize(io);
+		ras.serialize(io);
+		indirect.serialize(io);
+	}
+
+	static void storage(storage_report &r) {
+		r.add("btb", btb::STORAGE_BITS, STORAGE_TARGET);
+		r.add("return stack", return_stack::STORAGE_BITS, STORAGE_TARGET);
+		r.add("indirect predictor", ittage::STORAGE_BITS, STORAGE_TARGET);
+	}
+
+private:
+	btb targets;
+	return_stack ras;
+	ittage indirect;
+	uint32_t predicted;
+};
+
+#endif // TARGET_H
@@ -2,6 +2,27 @@
 // This file contains code for reading traces.  There's nothing in this
 // file you need to understand to participate in the branch prediction 
 // contest.
+//
+// All of the decoder's state lives in a trace_decoder, so a program can
+// decode several traces at once.  A trace index (see build_trace_index
+// below) snapshots that state every so many traces, so decoding can start
+// again from any snapshot instead of only from the beginning.
+//
+// Besides gzip, bzip2 and plain files, a trace may be in ct's compressed
+// container (see compress/container.h), which is read in-process: blocks
+// of the pre-processed stream, each compressed on its own either with
+// zlib or with the entropy coder in compress/tracecoder.h.  The latter
+// codes each trace in the context of the decoder's state, so it is
+// decoded a trace at a time, as read_trace asks for bytes.
+//
+// A trace need not be a file.  "-" reads it from standard input, and a
+// named pipe works like any other name, so a trace can be piped straight
+// from the tool that makes it.  The format is sniffed from the first bytes
+// of the stream itself.  A plain stream or a container is then read
+// in-process; a compressed one goes through the decompressor, which a
+// child process feeds with the sniffed bytes and the rest of the stream.
+// A stream cannot be rewound, so it is read front to back; seeking with
+// an index reads over what it skips.
 
 // djimenez
 
@@ -9,9 +30,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+using namespace std;
 
 #include "branch.h"
 #include "trace.h"
+#include "compress/container.h"
 
 // A trace is a piece of information about a branch.  The external 
 // representation of a trace is 9 bytes:
@@ -46,62 +75,10 @@
 
 #define BUFSIZE	10000
 
-// file pointer for the pipe from the decompressor
-
-FILE *tracefp;
-
-// buffer to read bytes into
-
-unsigned char buf[BUFSIZE];
-
-// current position in buffer
-unsigned int bufpos;
-
-// number of bytes read into buffer
-
-unsigned int bufsize;
-
-// true when end of file is reached
-
-bool end_of_file;
-
-// read a single byte from the trace file
-
-unsigned char read_byte (void) {
-
-	// if the buffer is empty...
-
-	if (bufpos == bufsize) {
-
-		// get a BUFSIZE-sized chunk of bytes from the input
-
-		bufpos = 0;
-		bufsize = fread (buf, 1, BUFSIZE, tracefp);
-
-		// nothing to read?  we must be done.
-
-		if (bufsize == 0) {
-			end_of_file = true;
-			return 0;
-		}
-	}
-
-	// one more byte 
-
-	return buf[bufpos++];
-}
+// the most bytes one trace takes in the stream: a return address prefix
+// and a 9-byte trace
 
-// read an unsigned integer in little endian format from the trace file
-
-unsigned int read_uint (void) {
-	unsigned int x0, x1, x2, x3;
-
-	x0 = read_byte ();
-	x1 = read_byte ();
-	x2 = read_byte ();
-	x3 = read_byte ();
-	return x0 | (x1 << 8) | (x2 << 16) | (x3 << 24);
-}
+#define MAX_TRACE_BYTES	10
 
 // these "remember" structs and functions handle decompressing certain traces
 // using prediction.  the compression is a simple table-based predictor that
@@ -138,65 +115,241 @@ struct remember {
 	}
 };
 
-// a return address stack
-                                                                                
+// size of the return address stack
+
 #define RAS_SIZE        100
-                                                                                
-unsigned int ras[RAS_SIZE];
-int ras_top = RAS_SIZE;
 
-// (re)initialize the return address stack
-void init_ras (void) {
-	ras_top = RAS_SIZE;
+// parameters for the predictor table
+
+#define N_REMEMBER	(1<<16)
+#define ASSOC		8
+
+// the state of one decoder
+
+struct trace_decoder {
+
+	// file pointer for the pipe from the decompressor, or for the
+	// container file or plain stream
+
+	FILE *tracefp;
+
+	// how tracefp was opened, and so how to close it: popen for a
+	// decompressor on a file, a child decompressor and its feeder for a
+	// compressed stream, or fopen for the rest.  seekable is whether
+	// tracefp is a regular file.
+
+	enum { INPUT_FILE, INPUT_POPEN, INPUT_CHILDREN } input;
+	pid_t children[2];
+	bool seekable;
+
+	// the bytes sniffed from a plain stream, which come before the rest
+
+	unsigned char prefix[4];
+	unsigned int prefix_size;
+
+	// buffer to read bytes into
+
+	unsigned char buf[BUFSIZE];
+
+	// the reader of a container, or NULL for a plain stream
+
+	container_reader *container;
+
+	// the bytes being read: buf or the container's data
+
+	const unsigned char *bytes;
+
+	// current position in buffer
+	unsigned int bufpos;
+
+	// number of bytes read into buffer
+
+	unsigned int bufsize;
+
+	// below this position, the rest of the trace at bufpos is surely in
+	// the buffer, so it can be decoded without checking for the end
+
+	unsigned int safe;
+
+	// offset in the decompressed stream of buf[0]
+
+	uint64_t bufstart;
+
+	// true when end of file is reached
+
+	bool end_of_file;
+
+	// a return address stack
+
+	unsigned int ras[RAS_SIZE];
+	int ras_top;
+
+	// the predictor table; a 64k-entry 8-way set associative memory.
+	// a hash table with probing would probably be more space-efficient
+	// but I think this is a little faster (neither has good locality).
+	// we can only remember up to 8 possible predictions per branch target
+	// because we're squeezing set indices into a 3-bit code so having
+	// a fixed set size is OK.  in practice, most branches need only 1 or 2
+	// possible predictions, but some traces benefit from higher associativity.
+
+	remember rtab[N_REMEMBER][ASSOC];
+
+	// which sets of rtab have changed since the last snapshot
+
+	bool dirty[N_REMEMBER];
+
+	// this int keeps time for the LRU algorithm
+
+	unsigned int now; 
+
+	// last trace seen
+
+	remember last_one; 
+
+	// the trace read_trace returns
+
+	trace t;
+
+	void reset (void);
+	bool refill (uint64_t skip);
+	unsigned char read_byte (void);
+	unsigned int read_uint (void);
+	template<bool checked> unsigned char next_byte (void);
+	template<bool checked> unsigned int next_uint (void);
+	void init_ras (void);
+	void push_ras (unsigned int a);
+	unsigned int pop_ras (void);
+	remember *predict_remember (void);
+	void update_remember (remember & me, remember *r, bool correct, int index);
+	template<bool checked> bool decode (trace &t);
+	trace *read_trace (void);
+	size_t read_traces (trace *out, size_t n);
+	size_t read_traces (trace_batch &out, size_t n);
+	bool skip_bytes (uint64_t n);
+	void write_snapshot (FILE *f, uint64_t traces);
+	bool read_snapshot (FILE *f, uint64_t &traces, uint64_t &offset);
+};
+
+// get the next chunk of bytes from the input, passing over whole
+// container blocks while they fit in the next skip bytes.  returns false
+// at the end of the input.
+
+bool trace_decoder::refill (uint64_t skip) {
+	bufstart += bufsize;
+	bufpos = 0;
+	bufsize = 0;
+	safe = 0;
+	if (end_of_file) return false;
+	if (!container) {
+		memcpy (buf, prefix, prefix_size);
+		bufsize = prefix_size;
+		prefix_size = 0;
+		bufsize += fread (buf + bufsize, 1, BUFSIZE - bufsize, tracefp);
+		if (bufsize >= MAX_TRACE_BYTES) safe = bufsize - MAX_TRACE_BYTES + 1;
+		return bufsize != 0;
+	}
+
+	// a container gives a block at a time, or for an entropy-coded
+	// one a trace at a time, coded in the context of the trace before it
+
+	bool more = container->next (last_one.target, skip);
+	bufstart += container->passed;
+	if (!more) {
+		end_of_file = true;
+		return false;
+	}
+	bytes = container->data.data ();
+	bufsize = container->data.size ();
+
+	// an entropy-coded unit is whole traces
+
+	if (container->format () == CONTAINER_CODED) safe = bufsize;
+	else if (bufsize >= MAX_TRACE_BYTES) safe = bufsize - MAX_TRACE_BYTES + 1;
+	return true;
 }
 
-// push a target onto the return address stack
+// read a single byte from the trace file
 
-void push_ras (unsigned int a) {
-	if (ras_top) ras[--ras_top] = a;
+unsigned char trace_decoder::read_byte (void) {
+
+	// if the buffer is empty...
+
+	if (bufpos == bufsize) {
+
+		// get the next chunk of bytes from the input.  nothing to
+		// read?  we must be done.
+
+		if (!refill (0)) {
+			end_of_file = true;
+			return 0;
+		}
+	}
+
+	// one more byte 
+
+	return bytes[bufpos++];
 }
 
-// pop a target from the return address stack
+// read an unsigned integer in little endian format from the trace file
 
-unsigned int pop_ras (void) {
-	if (ras_top < RAS_SIZE) return ras[ras_top++];
-	return 0;
+unsigned int trace_decoder::read_uint (void) {
+	unsigned int x0, x1, x2, x3;
+
+	x0 = read_byte ();
+	x1 = read_byte ();
+	x2 = read_byte ();
+	x3 = read_byte ();
+	return x0 | (x1 << 8) | (x2 << 16) | (x3 << 24);
 }
 
-// parameters for the predictor table
+// the next byte or unsigned integer of the trace being decoded; unchecked,
+// it must be known to be in the buffer
 
-#define N_REMEMBER	(1<<16)
-#define ASSOC		8
+template<bool checked> inline unsigned char trace_decoder::next_byte (void) {
+	if (checked) return read_byte ();
+	return bytes[bufpos++];
+}
 
-// the predictor table; a 64k-entry 8-way set associative memory.
-// a hash table with probing would probably be more space-efficient
-// but I think this is a little faster (neither has good locality).
-// we can only remember up to 8 possible predictions per branch target
-// because we're squeezing set indices into a 3-bit code so having
-// a fixed set size is OK.  in practice, most branches need only 1 or 2
-// possible predictions, but some traces benefit from higher associativity.
+template<bool checked> inline unsigned int trace_decoder::next_uint (void) {
+	if (checked) return read_uint ();
+	const unsigned char *p = bytes + bufpos;
+	bufpos += 4;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
 
-remember rtab[N_REMEMBER][ASSOC];
+// (re)initialize the return address stack
+void trace_decoder::init_ras (void) {
+	ras_top = RAS_SIZE;
+}
 
-// this int keeps time for the LRU algorithm
+// push a target onto the return address stack
 
-static unsigned int now = 0; 
+void trace_decoder::push_ras (unsigned int a) {
+	if (ras_top) ras[--ras_top] = a;
+}
 
-// last trace seen
+// pop a target from the return address stack
 
-static remember last_one; 
+unsigned int trace_decoder::pop_ras (void) {
+	if (ras_top < RAS_SIZE) return ras[ras_top++];
+	return 0;
+}
 
 // predict a trace
 
-remember *predict_remember (void) {
+remember *trace_decoder::predict_remember (void) {
 	unsigned int index = last_one.target & (N_REMEMBER-1);
 	remember *r = &rtab[index][0];
+
+	// whatever happens, update_remember will change this set
+
+	dirty[index] = true;
 	return r;
 }
 
 // update the predictor
 
-void update_remember (remember & me, remember *r, bool correct, int index) {
+void trace_decoder::update_remember (remember & me, remember *r, bool correct, int index) {
 	if (correct) {
 		r[index].lru_time = now++;
 	} else {
@@ -210,18 +363,18 @@ void update_remember (remember & me, remember *r, bool correct, int index) {
 	last_one = me;
 }
 
-// read a single trace from the file
+// decode a single trace from the file into t, returning false at the end
+// of the file.  unchecked, the whole trace must be in the buffer.
 
-trace *read_trace (void) {
-	static trace t;
+template<bool checked> inline bool trace_decoder::decode (trace &t) {
 	bool ras_correct, ras_offby2, ras_offby3, correct;
 
 	// read the next byte; it will either be a code, a set index for
 	// a correct prediction, or a prefix for patching a return address 
 	// prediction.
 
-	unsigned char c = read_byte ();
-	if (end_of_file) return NULL;
+	unsigned char c = next_byte<checked> ();
+	if (checked && end_of_file) return false;
 	remember r;
 
 	// predict the next trace
@@ -256,7 +409,7 @@ trace *read_trace (void) {
 		// read the next byte; it should be the set index for
 		// a correct return address prediction
 
-		c = read_byte ();
+		c = next_byte<checked> ();
 	}
 
 	// the byte is a correct prediction if it is less than 8;
@@ -330,11 +483,11 @@ trace *read_trace (void) {
 
 		// read the branch address
 
-		t.bi.address = read_uint ();
+		t.bi.address = next_uint<checked> ();
 
 		// read the branch target
 
-		t.target = read_uint ();
+		t.target = next_uint<checked> ();
 
 		// assume the branch is taken; fix later
 
@@ -410,7 +563,162 @@ trace *read_trace (void) {
 	// this should "never" happen
 	default: fprintf (stderr, "%d\n", c); fflush (stderr); assert (0);
 	}
-	return & t;
+	return true;
+}
+
+// read a single trace from the file
+
+trace *trace_decoder::read_trace (void) {
+	return decode<true> (t) ? &t : NULL;
+}
+
+// read up to n traces into out, returning how many there were.  only the
+// last few traces of each buffer are decoded with checks for its end.
+
+size_t trace_decoder::read_traces (trace *out, size_t n) {
+	size_t i = 0;
+	while (i < n) {
+		while (i < n && bufpos < safe) decode<false> (out[i++]);
+		if (i == n || !decode<true> (out[i])) break;
+		i++;
+	}
+	return i;
+}
+
+size_t trace_decoder::read_traces (trace_batch &out, size_t n) {
+	size_t i = 0;
+	trace u;
+	for (; i < n; i++) {
+		if (bufpos < safe) decode<false> (u);
+		else if (!decode<true> (u)) break;
+		out.taken[i] = u.taken;
+		out.target[i] = u.target;
+		out.address[i] = u.bi.address;
+		out.opcode[i] = u.bi.opcode;
+		out.br_flags[i] = u.bi.br_flags;
+	}
+	return i;
+}
+
+// start the decompression predictor from scratch, so a program can
+// read more than one trace
+
+void trace_decoder::reset (void) {
+	bufpos = 0;
+	bufsize = 0;
+	safe = 0;
+	bufstart = 0;
+	end_of_file = false;
+	for (int i=0; i<N_REMEMBER; i++)
+		for (int j=0; j<ASSOC; j++)
+			rtab[i][j] = remember ();
+	memset (dirty, 0, sizeof dirty);
+	last_one = remember ();
+	now = 0;
+	init_ras ();
+}
+
+// throw away the next n bytes of the decompressed stream
+
+bool trace_decoder::skip_bytes (uint64_t n) {
+	while (n) {
+		if (bufpos == bufsize) {
+			uint64_t start = bufstart + bufsize;
+			if (!refill (n)) return false;
+			n -= bufstart - start;
+			if (n == 0) break;
+		}
+		unsigned int k = (unsigned int) min ((uint64_t) (bufsize - bufpos), n);
+		bufpos += k;
+		n -= k;
+	}
+	return true;
+}
+
+// a snapshot holds everything but the predictor table, and then only the
+// sets of the table that changed since the previous snapshot:
+//	uint64_t traces		traces decoded before it
+//	uint64_t offset		bytes of the decompressed stream consumed
+//	uint32_t now
+//	remember last_one
+//	int32_t ras_top
+//	uint32_t ras[RAS_SIZE]
+//	uint32_t sets		changed sets that follow
+// and then each changed set as its uint32_t index and ASSOC remembers.  a
+// remember is written as code, taken, address, target and lru_time, in 14
+// bytes.  all integers are little-endian.
+
+static void write_remember (FILE *f, const remember &r) {
+	unsigned char b[2] = { r.code, r.taken };
+	fwrite (b, 1, 2, f);
+	fwrite (&r.address, 4, 1, f);
+	fwrite (&r.target, 4, 1, f);
+	fwrite (&r.lru_time, 4, 1, f);
+}
+
+static bool read_remember (FILE *f, remember &r) {
+	unsigned char b[2];
+	if (fread (b, 1, 2, f) != 2) return false;
+	r.code = b[0];
+	r.taken = b[1];
+	return fread (&r.address, 4, 1, f) == 1
+	    && fread (&r.target, 4, 1, f) == 1
+	    && fread (&r.lru_time, 4, 1, f) == 1;
+}
+
+void trace_decoder::write_snapshot (FILE *f, uint64_t traces) {
+	uint64_t offset = bufstart + bufpos;
+	int32_t top = ras_top;
+	uint32_t sets = 0;
+	for (int i=0; i<N_REMEMBER; i++) sets += dirty[i];
+	fwrite (&traces, sizeof traces, 1, f);
+	fwrite (&offset, sizeof offset, 1, f);
+	fwrite (&now, sizeof now, 1, f);
+	write_remember (f, last_one);
+	fwrite (&top, sizeof top, 1, f);
+	fwrite (ras, sizeof ras, 1, f);
+	fwrite (&sets, sizeof sets, 1, f);
+	for (uint32_t i=0; i<N_REMEMBER; i++) {
+		if (!dirty[i]) continue;
+		fwrite (&i, sizeof i, 1, f);
+		for (int j=0; j<ASSOC; j++) write_remember (f, rtab[i][j]);
+		dirty[i] = false;
+	}
+}
+
+// apply the next snapshot in f on top of the state the snapshots before
+// it built up
+
+bool trace_decoder::read_snapshot (FILE *f, uint64_t &traces, uint64_t &offset) {
+	int32_t top;
+	uint32_t sets;
+	if (fread (&traces, sizeof traces, 1, f) != 1
+	 || fread (&offset, sizeof offset, 1, f) != 1
+	 || fread (&now, sizeof now, 1, f) != 1
+	 || !read_remember (f, last_one)
+	 || fread (&top, sizeof top, 1, f) != 1
+	 || fread (ras, sizeof ras, 1, f) != 1
+	 || fread (&sets, sizeof sets, 1, f) != 1) return false;
+	if (top < 0 || top > RAS_SIZE) return false;
+	ras_top = top;
+	for (uint32_t k=0; k<sets; k++) {
+		uint32_t i;
+		if (fread (&i, sizeof i, 1, f) != 1 || i >= N_REMEMBER) return false;
+		for (int j=0; j<ASSOC; j++)
+			if (!read_remember (f, rtab[i][j])) return false;
+	}
+	return true;
+}
+
+// pass over the next snapshot in f, reading only where it is
+
+static bool skip_snapshot (FILE *f, uint64_t &traces, uint64_t &offset) {
+	uint32_t sets;
+	return fread (&traces, sizeof traces, 1, f) == 1
+	    && fread (&offset, sizeof offset, 1, f) == 1
+	    && fseek (f, 4 + 14 + 4 + RAS_SIZE * 4, SEEK_CUR) == 0
+	    && fread (&sets, sizeof sets, 1, f) == 1
+	    && fseek (f, sets * (4 + ASSOC * 14L), SEEK_CUR) == 0;
 }
 
 // open the trace file for reading
@@ -418,44 +726,331 @@ trace *read_trace (void) {
 #define GZIP_MAGIC     "\037\213"
 #define BZIP2_MAGIC	"BZ"
 
-void init_trace (char *fname) {
-	char *dc;
-	char s[2] = { 0, 0 };
+trace_reader::trace_reader (void) : d (new trace_decoder) {
+	d->tracefp = NULL;
+	d->container = NULL;
+}
+
+trace_reader::~trace_reader (void) {
+	if (d->tracefp) close ();
+	delete d;
+}
+
+// run the decompressor dc on a stream whose first n bytes, already read
+// from in, are in prefix.  a child feeds the decompressor those bytes and
+// then the rest of in; in is closed here either way.  returns the
+// decompressor's output, or NULL after saying why.
+
+static FILE *decompress_stream (const char *dc, FILE *in, const unsigned char *prefix, size_t n, pid_t children[2]) {
+	int feed[2], out[2];
+	if (pipe (feed) != 0) {
+		fclose (in);
+		return NULL;
+	}
+	if (pipe (out) != 0) {
+		close (feed[0]);
+		close (feed[1]);
+		fclose (in);
+		return NULL;
+	}
+	children[0] = fork ();
+	if (children[0] == 0) {
+		dup2 (feed[0], 0);
+		dup2 (out[1], 1);
+		close (feed[0]);
+		close (feed[1]);
+		close (out[0]);
+		close (out[1]);
+		execl ("/bin/sh", "sh", "-c", dc, (char *) NULL);
+		_exit (127);
+	}
+	children[1] = children[0] < 0 ? -1 : fork ();
+	if (children[1] == 0) {
+		close (feed[0]);
+		close (out[0]);
+		close (out[1]);
+		unsigned char buf[BUFSIZE];
+		bool ok = write (feed[1], prefix, n) == (ssize_t) n;
+		for (size_t k; ok && (k = fread (buf, 1, sizeof buf, in)) > 0; ) ok = write (feed[1], buf, k) == (ssize_t) k;
+		_exit (0);
+	}
+	close (feed[0]);
+	close (feed[1]);
+	close (out[1]);
+	fclose (in);
+	if (children[1] < 0) {
+		close (out[0]);
+		if (children[0] > 0) waitpid (children[0], NULL, 0);
+		return NULL;
+	}
+	return fdopen (out[0], "r");
+}
+
+bool trace_reader::open (const char *fname) {
+	const char *dc;
+	unsigned char s[4] = { 0, 0, 0, 0 };
 	char cmd[1000];
 
-	// figure out the compression method from the magic number
+	// figure out the compression method from the magic number, read
+	// from the stream itself
 
-	FILE *f = fopen (fname, "r");
+	bool from_stdin = strcmp (fname, "-") == 0;
+	FILE *f = from_stdin ? stdin : fopen (fname, "rb");
 	if (!f) {
 		perror (fname);
+		return false;
 	}
-	fread (s, 1, 2, f);
-	fclose (f);
-	if (strncmp (s, GZIP_MAGIC, 2) == 0) 
+	struct stat st;
+	d->seekable = fstat (fileno (f), &st) == 0 && S_ISREG (st.st_mode);
+	size_t n = fread (s, 1, 4, f);
+	d->input = trace_decoder::INPUT_FILE;
+	d->prefix_size = 0;
+
+	// a container is read directly
+
+	if (n == 4 && memcmp (s, CONTAINER_MAGIC, 4) == 0) {
+		d->container = new container_reader (f, d->seekable);
+		if (!d->container->good ()) {
+			fprintf (stderr, "%s: bad container header\n", fname);
+			delete d->container;
+			d->container = NULL;
+			fclose (f);
+			return false;
+		}
+		d->tracefp = f;
+		d->reset ();
+		return true;
+	}
+	d->bytes = d->buf;
+	if (n >= 2 && memcmp (s, GZIP_MAGIC, 2) == 0)
 		dc = ZCAT;
-	else if (strncmp (s, BZIP2_MAGIC, 2) == 0)
+	else if (n >= 2 && memcmp (s, BZIP2_MAGIC, 2) == 0)
 		dc = BZCAT;
 	else
-		dc = CAT;
+		dc = NULL;
+
+	// a plain stream is read directly, after the bytes already sniffed.
+	// standard input is a stream even when it is a file, having no name
+	// to hand a decompressor.
+
+	bool stream = from_stdin || !d->seekable;
+	if (!dc && stream) {
+		memcpy (d->prefix, s, n);
+		d->prefix_size = n;
+		d->tracefp = f;
+		d->reset ();
+		return true;
+	}
+
+	// a compressed stream goes through the decompressor
+
+	if (stream) {
+		d->tracefp = decompress_stream (dc, f, s, n, d->children);
+		if (!d->tracefp) {
+			perror (fname);
+			return false;
+		}
+		d->input = trace_decoder::INPUT_CHILDREN;
+		d->reset ();
+		return true;
+	}
+	fclose (f);
 
 	// make a command that will decompress the file to stdout
 
-	sprintf (cmd, "%s %s", dc, fname);
+	snprintf (cmd, sizeof cmd, "%s %s", dc ? dc : CAT, fname);
 
 	// pipe that stdout to tracefp
 
-	tracefp = popen (cmd, "r");
-	if (!tracefp) {
+	d->tracefp = popen (cmd, "r");
+	if (!d->tracefp) {
 		perror (fname);
-		exit (1);
+		return false;
 	}
-	bufpos = 0;
-	bufsize = 0;
-	end_of_file = false;
+	d->input = trace_decoder::INPUT_POPEN;
+	d->reset ();
+	return true;
+}
+
+trace *trace_reader::read (void) {
+	return d->read_trace ();
+}
+
+size_t trace_reader::read (trace *out, size_t n) {
+	return d->read_traces (out, n);
+}
+
+size_t trace_reader::read (trace_batch &out, size_t n) {
+	return d->read_traces (out, n);
+}
+
+void trace_reader::close (void) {
+	delete d->container;
+	d->container = NULL;
+	if (d->input == trace_decoder::INPUT_POPEN) {
+		pclose (d->tracefp);
+	} else {
+		fclose (d->tracefp);
+	}
+
+	// the feeder is done at the end of the stream; before then it may be
+	// waiting on whatever writes the stream, so it is stopped
+
+	if (d->input == trace_decoder::INPUT_CHILDREN) {
+		kill (d->children[1], SIGTERM);
+		waitpid (d->children[0], NULL, 0);
+		waitpid (d->children[1], NULL, 0);
+	}
+	d->tracefp = NULL;
+}
+
+// a trace index is a 20-byte header followed by snapshots:
+//	"BTIX"			magic
+//	uint32_t version	1
+//	uint32_t interval	traces between snapshots
+//	uint64_t traces		traces in the whole trace file
+// there is a snapshot for every trace k * interval, and for an
+// entropy-coded container one more at the start of each block that does
+// not start at such a trace.  each must be applied after all the ones
+// before it.
+
+#define INDEX_MAGIC	"BTIX"
+#define INDEX_HEADER_SIZE	20
+
+static bool read_index_header (FILE *f, uint32_t &interval, uint64_t &traces) {
+	char magic[4];
+	uint32_t version;
+	return fread (magic, 4, 1, f) == 1 && memcmp (magic, INDEX_MAGIC, 4) == 0
+	    && fread (&version, sizeof version, 1, f) == 1 && version == 1
+	    && fread (&interval, sizeof interval, 1, f) == 1 && interval > 0
+	    && fread (&traces, sizeof traces, 1, f) == 1;
+}
+
+bool trace_reader::seek (const char *index, uint64_t n) {
+	FILE *f = fopen (index, "rb");
+	if (!f) {
+		perror (index);
+		return false;
+	}
+	uint32_t interval;
+	uint64_t traces, at = 0, offset = 0;
+	bool ok = read_index_header (f, interval, traces);
+	if (!ok) fprintf (stderr, "%s: not a trace index\n", index);
+	else if (n % interval || n > traces) {
+		fprintf (stderr, "%s: no snapshot for trace %llu\n", index, (unsigned long long) n);
+		ok = false;
+	}
+
+	// an entropy-coded container codes each trace in the context of
+	// the state before it, and can only be entered where a block
+	// starts.  find the last block before trace n that has a snapshot
+	// -- trace 0, with an old index -- go there, and decode the rest.
+
+	if (ok && d->container && d->container->format () == CONTAINER_CODED) {
+		uint64_t snapshots = 0, k = 0;
+		while (ok && at < n) {
+			ok = skip_snapshot (f, at, offset);
+			k++;
+			if (!ok) fprintf (stderr, "%s: truncated index\n", index);
+			else if (at < n && at % interval) snapshots = k;
+		}
+		at = offset = 0;
+		fseek (f, INDEX_HEADER_SIZE, SEEK_SET);
+		for (uint64_t i = 0; ok && i < snapshots; i++) {
+			ok = d->read_snapshot (f, at, offset);
+			if (!ok) fprintf (stderr, "%s: truncated index\n", index);
+		}
+		fclose (f);
+		if (!ok) return false;
+		if (!d->skip_bytes (offset)) {
+			fprintf (stderr, "%s: the trace is shorter than its index says\n", index);
+			return false;
+		}
+		for (; at < n; at++) {
+			if (!d->read_trace ()) {
+				fprintf (stderr, "%s: the trace is shorter than its index says\n", index);
+				return false;
+			}
+		}
+		return true;
+	}
+	while (ok && at < n) {
+		ok = d->read_snapshot (f, at, offset);
+		if (!ok) fprintf (stderr, "%s: truncated index\n", index);
+	}
+	fclose (f);
+	if (ok && !d->skip_bytes (offset)) {
+		fprintf (stderr, "%s: the trace is shorter than its index says\n", index);
+		ok = false;
+	}
+	return ok;
+}
+
+bool index_info (const char *index, uint32_t &interval, uint64_t &traces) {
+	FILE *f = fopen (index, "rb");
+	if (!f) {
+		perror (index);
+		return false;
+	}
+	bool ok = read_index_header (f, interval, traces);
+	if (!ok) fprintf (stderr, "%s: not a trace index\n", index);
+	fclose (f);
+	return ok;
+}
+
+bool build_trace_index (const char *fname, const char *index, uint32_t interval) {
+	trace_reader r;
+	if (!r.open (fname)) return false;
+	FILE *f = fopen (index, "wb");
+	if (!f) {
+		perror (index);
+		r.close ();
+		return false;
+	}
+
+	// the header goes first, and is rewritten with the count at the end
+
+	uint32_t version = 1;
+	uint64_t traces = 0;
+	fwrite (INDEX_MAGIC, 4, 1, f);
+	fwrite (&version, sizeof version, 1, f);
+	fwrite (&interval, sizeof interval, 1, f);
+	fwrite (&traces, sizeof traces, 1, f);
+	container_reader *c = r.d->container;
+	while (r.read ()) {
+		if (++traces % interval == 0 || (c && c->block_end ())) r.d->write_snapshot (f, traces);
+	}
+	r.close ();
+	fseek (f, INDEX_HEADER_SIZE - sizeof traces, SEEK_SET);
+	fwrite (&traces, sizeof traces, 1, f);
+	bool ok = !ferror (f);
+	if (fclose (f) != 0) ok = false;
+	if (!ok) perror (index);
+	return ok;
+}
+
+// the original interface, on one global reader
+
+static trace_reader global_reader;
+
+void init_trace (char *fname) {
+	if (!global_reader.open (fname)) exit (1);
+}
+
+trace *read_trace (void) {
+	return global_reader.read ();
+}
+
+size_t read_traces (trace *out, size_t n) {
+	return global_reader.read (out, n);
+}
+
+size_t read_traces (trace_batch &out, size_t n) {
+	return global_reader.read (out, n);
 }
 
 // close the trace file
 
 void end_trace (void) {
-	fclose (tracefp);
+	global_reader.close ();
 }
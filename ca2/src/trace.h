@@ -1,6 +1,12 @@
 // trace.h
 // This file declares functions and a struct for reading trace files.
 
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
 // these #define the Unix commands for decompressing gzip, bzip2, and
 // plain files.  If they are somewhere else on your system, change these
 // definitions.
@@ -15,6 +21,73 @@ struct trace {
 	branch_info bi;
 };
 
+// traces as one array per field, for code that goes over a field at a
+// time; each array holds as many traces as are asked for
+
+struct trace_batch {
+	bool *taken;
+	unsigned int *target, *address, *opcode, *br_flags;
+};
+
+// read one trace file at a time.  read_traces reads up to n traces at
+// once, returning how many there were; 0 means the end of the file.
+
 void init_trace (char *);
 trace *read_trace (void);
+size_t read_traces (trace *out, size_t n);
+size_t read_traces (trace_batch &out, size_t n);
 void end_trace (void);
+
+// a reader for one trace file; any number can be open at once
+
+struct trace_decoder;
+
+class trace_reader {
+public:
+	trace_reader (void);
+	~trace_reader (void);
+
+	// open fname, saying why and returning false if that fails.  "-" is
+	// standard input; it and named pipes are read as they stream in.
+
+	bool open (const char *fname);
+
+	// the next trace, or NULL at the end of the file.  the trace is
+	// overwritten by the next call.
+
+	trace *read (void);
+
+	// up to n traces into out, returning how many there were; 0 means
+	// the end of the file.  this is much faster than n calls to read.
+
+	size_t read (trace *out, size_t n);
+	size_t read (trace_batch &out, size_t n);
+
+	void close (void);
+
+	// go to trace n of the file just opened, from its index (see
+	// build_trace_index); n must be a multiple of the index interval.
+	// in an entropy-coded container it starts at the last block before
+	// trace n and decodes the traces up to it.
+	// returns false, after saying why, if that fails.
+
+	bool seek (const char *index, uint64_t n);
+
+private:
+	trace_decoder *d;
+
+	trace_reader (const trace_reader &);
+	friend bool build_trace_index (const char *, const char *, uint32_t);
+};
+
+// write an index of trace file fname, with a snapshot of the decoder every
+// interval traces and at each block of an entropy-coded container, to the
+// file index.  returns false, after saying why, on error.
+
+bool build_trace_index (const char *fname, const char *index, uint32_t interval);
+
+// read the snapshot interval and the total number of traces from an index
+
+bool index_info (const char *index, uint32_t &interval, uint64_t &traces);
+
+#endif // TRACE_H
@@ -0,0 +1,370 @@
+// tracegen.cc
+// This file contains the synthetic trace generator.  It reads a workload
+// description and writes the branches a program of that shape would
+// execute, as raw 9-byte traces (see trace.cc), which read_trace reads as
+// they are and compress/ct can pre-process and compress.  A workload can
+// aim at one predictor component at a time, or make a trace as long as
+// wanted for timing predict itself.
+//
+// Usage: tracegen [-n branches] [-s seed] [-o file] workload
+//	-n branches	branches to write (default: the workload's, or 1000000)
+//	-s seed		random seed (default: the workload's, or 1)
+//	-o file		where to write the trace (default: standard output)
+//
+// A workload is a list of statements, one to a line, that runs over and
+// over until enough branches are written, with an unconditional jump
+// back to the top each time.  "#" starts a comment.
+//	branches n		default number of branches to write
+//	seed n			default random seed
+//	random p		a conditional branch taken with probability p
+//	correlated d [p]	a conditional branch with the outcome of the
+//				conditional branch d before it, flipped with
+//				probability p (default 0)
+//	pattern s		a conditional branch that follows the string s
+//				of T and N over and over
+//	indirect k [cycle]	an indirect jump to one of k targets, picked at
+//				random or, with cycle, in turn
+//	loop n [j] ... end	the statements up to the matching end, run n
+//				times, give or take up to j at random each
+//				time, closed by a backward conditional branch
+//	call d ... end		the statements up to the matching end, run
+//				inside d nested calls, each then returned from
+// For example, a loop of 10 around two branches, the second of which
+// repeats the first:
+//	loop 10
+//		random 0.5
+//		correlated 1
+//	end
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "xorshift.h"
+
+// how far back correlated branches can look
+
+#define MAX_DISTANCE	4096
+
+// where code and called functions are laid out
+
+#define CODE_BASE	0x08048000
+#define FUNCTION_BASE	0x08200000
+#define FUNCTION_SIZE	0x100
+
+// trace codes (see trace.cc); a conditional branch adds its opcode
+
+#define CODE_TAKEN		0x10
+#define CODE_NOT_TAKEN		0x20
+#define CODE_JUMP		0x30
+#define CODE_INDIRECT		0x40
+#define CODE_CALL		0x50
+#define CODE_RETURN		0x70
+
+enum kind {
+	RANDOM,
+	CORRELATED,
+	PATTERN,
+	INDIRECT,
+	LOOP,
+	CALL
+};
+
+struct statement {
+	kind k;
+
+	// the bias of RANDOM and the noise of CORRELATED
+
+	double p;
+
+	// the distance of CORRELATED, the targets of INDIRECT, the trips of
+	// LOOP and the depth of CALL, and for LOOP the jitter
+
+	uint32_t n, jitter;
+	bool cycle;
+	string pattern;
+
+	// where the branch is and where it goes when taken.  for LOOP the
+	// branch is the one at the bottom; for CALL these are per level.
+
+	uint32_t address, target;
+	vector<uint32_t> sites, functions, targets;
+
+	// how far along PATTERN or a cycling INDIRECT is
+
+	uint64_t position;
+	vector<statement> body;
+};
+
+static FILE *out;
+static uint64_t remaining;
+static xorshift rng;
+static uint32_t code_address = CODE_BASE, function_address = FUNCTION_BASE;
+
+// the outcomes of the last MAX_DISTANCE conditional branches
+
+static bool history[MAX_DISTANCE];
+static uint64_t conditionals;
+
+static void emit (unsigned char code, uint32_t address, uint32_t target) {
+	unsigned char r[9];
+	r[0] = code;
+	for (int i = 0; i < 4; i++) {
+		r[1+i] = address >> (8 * i);
+		r[5+i] = target >> (8 * i);
+	}
+	if (fwrite (r, 9, 1, out) != 1) {
+		perror ("writing trace");
+		exit (1);
+	}
+	remaining--;
+}
+
+// a conditional branch; not taken, it falls through to the next
+// instruction after its 2 bytes
+
+static void conditional_branch (const statement &s, bool taken) {
+	unsigned char opcode = (s.address >> 1) & 15;
+	if (taken) emit (CODE_TAKEN | opcode, s.address, s.target);
+	else emit (CODE_NOT_TAKEN | opcode, s.address, s.address + 2);
+	history[conditionals++ % MAX_DISTANCE] = taken;
+}
+
+static bool chance (double p) {
+	return rng.next () < p * 4294967296.0;
+}
+
+static void run (vector<statement> &list);
+
+static void run (statement &s) {
+	switch (s.k) {
+	case RANDOM:
+		conditional_branch (s, chance (s.p));
+		break;
+	case CORRELATED: {
+		bool past = conditionals >= s.n && history[(conditionals - s.n) % MAX_DISTANCE];
+		conditional_branch (s, past != chance (s.p));
+		break;
+	}
+	case PATTERN:
+		conditional_branch (s, s.pattern[s.position++ % s.pattern.size ()] == 'T');
+		break;
+	case INDIRECT: {
+		uint32_t i = s.cycle ? s.position++ % s.n : rng.next () % s.n;
+		emit (CODE_INDIRECT, s.address, s.targets[i]);
+		break;
+	}
+	case LOOP: {
+		uint32_t trips = s.n;
+		if (s.jitter) {
+			int64_t t = (int64_t) trips + (int64_t) (rng.next () % (2 * s.jitter + 1)) - s.jitter;
+			trips = t < 1 ? 1 : (uint32_t) t;
+		}
+		for (uint32_t i = 0; i < trips && remaining; i++) {
+			run (s.body);
+			if (remaining) conditional_branch (s, i + 1 < trips);
+		}
+		break;
+	}
+	case CALL: {
+		uint32_t d = 0;
+		for (; d < s.n && remaining; d++) emit (CODE_CALL, s.sites[d], s.functions[d]);
+		run (s.body);
+		while (d-- && remaining) emit (CODE_RETURN, s.functions[d] + FUNCTION_SIZE - 1, s.sites[d] + 5);
+		break;
+	}
+	}
+}
+
+static void run (vector<statement> &list) {
+	for (size_t i = 0; i < list.size () && remaining; i++) run (list[i]);
+}
+
+// lay out a statement's branch in the code
+
+static void place (statement &s, uint32_t size) {
+	s.address = code_address;
+	s.target = code_address + size + 8;
+	code_address += size + 16;
+}
+
+static uint32_t new_function (void) {
+	uint32_t a = function_address;
+	function_address += FUNCTION_SIZE;
+	return a;
+}
+
+static bool parse_statement (statement &s, const char *key, const char *value) {
+	char word[64] = "";
+	s.p = 0;
+	s.n = 0;
+	s.jitter = 0;
+	s.cycle = false;
+	s.position = 0;
+	if (strcmp (key, "random") == 0) {
+		s.k = RANDOM;
+		if (sscanf (value, "%lf", &s.p) != 1 || s.p < 0 || s.p > 1) return false;
+		place (s, 2);
+	} else if (strcmp (key, "correlated") == 0) {
+		s.k = CORRELATED;
+		int got = sscanf (value, "%u %lf", &s.n, &s.p);
+		if (got < 1 || s.n < 1 || s.n > MAX_DISTANCE || s.p < 0 || s.p > 1) return false;
+		place (s, 2);
+	} else if (strcmp (key, "pattern") == 0) {
+		s.k = PATTERN;
+		if (sscanf (value, "%63s", word) != 1 || strspn (word, "TN") != strlen (word)) return false;
+		s.pattern = word;
+		place (s, 2);
+	} else if (strcmp (key, "indirect") == 0) {
+		s.k = INDIRECT;
+		int got = sscanf (value, "%u %63s", &s.n, word);
+		if (got < 1 || s.n < 1 || (got == 2 && strcmp (word, "cycle") != 0)) return false;
+		s.cycle = got == 2;
+		place (s, 2);
+		for (uint32_t i = 0; i < s.n; i++) s.targets.push_back (new_function ());
+	} else if (strcmp (key, "loop") == 0) {
+		s.k = LOOP;
+		int got = sscanf (value, "%u %u", &s.n, &s.jitter);
+		if (got < 1 || s.n < 1) return false;
+
+		// the backward branch goes to the top of the body; it is
+		// placed once the body is
+
+		s.target = code_address;
+	} else if (strcmp (key, "call") == 0) {
+		s.k = CALL;
+		if (sscanf (value, "%u", &s.n) != 1 || s.n < 1) return false;
+
+		// the first call is from here and each other from the
+		// function before it
+
+		s.sites.push_back (code_address);
+		code_address += 16;
+		for (uint32_t i = 0; i < s.n; i++) {
+			s.functions.push_back (new_function ());
+			if (i + 1 < s.n) s.sites.push_back (s.functions[i] + 8);
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool read_workload (const char *fname, vector<statement> &top, uint64_t &branches, uint32_t &seed) {
+	FILE *f = fopen (fname, "r");
+	if (!f) {
+		perror (fname);
+		return false;
+	}
+
+	// the loops and calls not yet ended and the statement lists being
+	// filled, innermost last.  only the innermost list grows, so the
+	// pointers into the others stay good.
+
+	vector<statement *> open;
+	vector<vector<statement> *> lists (1, &top);
+	char line[1000];
+	int lineno = 0;
+	bool ok = true;
+	while (ok && fgets (line, sizeof line, f)) {
+		lineno++;
+		char *hash = strchr (line, '#');
+		if (hash) *hash = 0;
+		char key[64];
+		int used;
+		if (sscanf (line, " %63s %n", key, &used) != 1) continue;
+		const char *value = line + used;
+
+		if (strcmp (key, "branches") == 0) {
+			unsigned long long n;
+			ok = sscanf (value, "%llu", &n) == 1;
+			branches = n;
+		} else if (strcmp (key, "seed") == 0) {
+			ok = sscanf (value, "%u", &seed) == 1;
+		} else if (strcmp (key, "end") == 0) {
+			ok = !open.empty ();
+			if (ok) {
+				statement *s = open.back ();
+				if (s->k == LOOP) {
+					s->address = code_address;
+					code_address += 16;
+				}
+				ok = !s->body.empty ();
+				open.pop_back ();
+				lists.pop_back ();
+			}
+		} else {
+			lists.back ()->push_back (statement ());
+			statement &s = lists.back ()->back ();
+			ok = parse_statement (s, key, value);
+			if (ok && (s.k == LOOP || s.k == CALL)) {
+				open.push_back (&s);
+				lists.push_back (&s.body);
+			}
+		}
+		if (!ok) fprintf (stderr, "%s:%d: bad workload line: %s", fname, lineno, line);
+	}
+	fclose (f);
+	if (ok && !open.empty ()) {
+		fprintf (stderr, "%s: a loop or call is missing its end\n", fname);
+		ok = false;
+	}
+	if (ok && top.empty ()) {
+		fprintf (stderr, "%s: no statements\n", fname);
+		ok = false;
+	}
+	return ok;
+}
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-n branches] [-s seed] [-o file] workload\n", prog);
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	long long int branches = -1;
+	long long int seed = -1;
+	const char *output = NULL;
+	int c;
+
+	while ((c = getopt (argc, argv, "n:s:o:")) != -1) {
+		switch (c) {
+		case 'n':
+			branches = atoll (optarg);
+			if (branches <= 0) usage (argv[0]);
+			break;
+		case 's': seed = atoll (optarg); break;
+		case 'o': output = optarg; break;
+		default: usage (argv[0]);
+		}
+	}
+	if (argc - optind != 1) usage (argv[0]);
+
+	vector<statement> top;
+	uint64_t workload_branches = 1000000;
+	uint32_t workload_seed = DEFAULT_SEED;
+	if (!read_workload (argv[optind], top, workload_branches, workload_seed)) exit (1);
+	remaining = branches > 0 ? (uint64_t) branches : workload_branches;
+	rng = xorshift (seed >= 0 ? (uint32_t) seed : workload_seed);
+
+	out = output ? fopen (output, "wb") : stdout;
+	if (!out) {
+		perror (output);
+		exit (1);
+	}
+	uint32_t bottom = code_address;
+	while (remaining) {
+		run (top);
+		if (remaining) emit (CODE_JUMP, bottom, CODE_BASE);
+	}
+	if (fclose (out) != 0) {
+		perror ("writing trace");
+		exit (1);
+	}
+	exit (0);
+}
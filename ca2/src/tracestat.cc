@@ -0,0 +1,410 @@
+// tracestat.cc
+// This file contains the trace characterization tool.  It reads each trace
+// once and reports what shapes a predictor's choice of geometry:
+//	- the mix of branch classes, dynamic and static
+//	- the static footprint, and how few branches cover most executions
+//	- the distribution of conditional branches' taken rates, and the
+//	  entropy of their bias
+//	- the trip counts of loops, seen as backward conditional branches
+//	- the call depth
+//	- how the set of branches executed grows over the trace
+// Memory is bounded by the static branch table, whatever the trace's
+// length; branches beyond its size are counted only in the totals.  Traces
+// are read in parallel, one per thread, and reported in the order given.
+//
+// Usage: tracestat [-j threads] [-s size] [-i interval] trace|directory...
+//	-j threads	worker threads (default: one per core)
+//	-s size		log2 of the static branch table size (default 18)
+//	-i interval	branches per working set interval (default 10000000)
+// A directory stands for every trace file ("*.trace*") under it, so
+// "tracestat ../traces" covers all the distributed traces.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "branch.h"
+#include "trace.h"
+
+#define BATCH_SIZE	4096
+
+// histogram buckets: taken rates in tenths, trip counts and call depths in
+// powers of two
+
+#define RATE_BUCKETS	10
+#define LOG_BUCKETS	16
+
+// the branch classes, as br_flags gives them
+
+enum {
+	CLASS_CONDITIONAL, CLASS_JUMP, CLASS_INDIRECT, CLASS_CALL, CLASS_INDIRECT_CALL, CLASS_RETURN, N_CLASSES
+};
+
+static const char *class_names[N_CLASSES] = {
+	"conditional", "jump", "indirect jump", "call", "indirect call", "return"
+};
+
+static int class_of (const branch_info &bi) {
+	if (bi.br_flags & BR_CONDITIONAL) return CLASS_CONDITIONAL;
+	if (bi.br_flags & BR_RETURN) return CLASS_RETURN;
+	if (bi.br_flags & BR_CALL) return (bi.br_flags & BR_INDIRECT) ? CLASS_INDIRECT_CALL : CLASS_CALL;
+	if (bi.br_flags & BR_INDIRECT) return CLASS_INDIRECT;
+	return CLASS_JUMP;
+}
+
+// the bucket of n among powers of two: 0 for 1, 1 for 2..3, and so on
+
+static int log_bucket (uint64_t n) {
+	int b = 0;
+	while (n > 1 && b < LOG_BUCKETS - 1) {
+		n >>= 1;
+		b++;
+	}
+	return b;
+}
+
+// one static branch
+
+struct branch_stats {
+	uint32_t address;
+	uint8_t kind;
+	bool backward;
+	uint64_t executions, taken;
+	uint32_t run;		// taken in a row so far, for a backward branch
+	uint32_t interval;	// last working set interval it ran in, plus 1
+};
+
+// the static branches of one trace, open addressed with linear probing
+// and never more than 7/8 full
+
+struct branch_table {
+	vector<branch_stats> entries;
+	uint32_t mask;
+	size_t used;
+
+	explicit branch_table (int size_log) : entries (size_t (1) << size_log), mask ((1u << size_log) - 1), used (0) {}
+
+	// the entry for address, or NULL if it is new and the table is full.
+	// a new entry has no executions yet.
+
+	branch_stats *lookup (uint32_t address, int kind) {
+		uint32_t h = (address * 0x9e3779b1u) & mask;
+		for (;;) {
+			branch_stats &b = entries[h];
+			if (b.executions == 0) break;
+			if (b.address == address) return &b;
+			h = (h + 1) & mask;
+		}
+		if (used >= entries.size () - entries.size () / 8) return NULL;
+		used++;
+		branch_stats &b = entries[h];
+		b.address = address;
+		b.kind = kind;
+		b.backward = false;
+		b.taken = 0;
+		b.run = 0;
+		b.interval = 0;
+		return &b;
+	}
+};
+
+// everything counted for one trace.  the static branch table is summed up
+// and let go as soon as the trace is read, so only the threads' tables
+// are ever held at once.
+
+struct trace_stats {
+	string name;
+	bool ok;
+	uint64_t branches, dynamic[N_CLASSES], statics[N_CLASSES], untracked;
+	uint64_t trips[LOG_BUCKETS], depths[LOG_BUCKETS], max_depth, depth_sum;
+
+	// per interval: branches first seen in it, and branches run in it
+
+	vector<uint64_t> new_branches, live_branches;
+
+	// from the static branches: how many of the hottest cover 50, 90 and
+	// 99 percent of the executions; and the conditional branches' taken
+	// rates and summed bias entropy, by static branch and by execution
+
+	size_t cover[3];
+	uint64_t rate_static[RATE_BUCKETS], rate_dynamic[RATE_BUCKETS];
+	uint64_t conditional_static, conditional_dynamic;
+	double entropy_static, entropy_dynamic;
+
+	explicit trace_stats (const string &fname) : name (fname), ok (false), branches (0), untracked (0),
+		max_depth (0), depth_sum (0), conditional_static (0), conditional_dynamic (0),
+		entropy_static (0), entropy_dynamic (0) {
+		memset (dynamic, 0, sizeof dynamic);
+		memset (statics, 0, sizeof statics);
+		memset (trips, 0, sizeof trips);
+		memset (depths, 0, sizeof depths);
+		memset (cover, 0, sizeof cover);
+		memset (rate_static, 0, sizeof rate_static);
+		memset (rate_dynamic, 0, sizeof rate_dynamic);
+	}
+};
+
+static int table_log = 18;
+static uint64_t interval = 10000000;
+static vector<trace_stats *> results;
+static atomic<size_t> next_trace (0);
+
+// the binary entropy of a bias p, in bits
+
+static double entropy (double p) {
+	if (p <= 0 || p >= 1) return 0;
+	return -p * log2 (p) - (1 - p) * log2 (1 - p);
+}
+
+static void count (trace_stats &s, branch_table &table, const trace &t, uint64_t &depth) {
+	int kind = class_of (t.bi);
+	s.dynamic[kind]++;
+
+	// call depth, as the calls and returns nest
+
+	if (kind == CLASS_CALL || kind == CLASS_INDIRECT_CALL) depth++;
+	else if (kind == CLASS_RETURN && depth) depth--;
+	s.depths[log_bucket (depth + 1)]++;
+	s.depth_sum += depth;
+	if (depth > s.max_depth) s.max_depth = depth;
+
+	uint32_t now = s.branches / interval + 1;
+	s.branches++;
+	branch_stats *b = table.lookup (t.bi.address, kind);
+	if (!b) {
+		s.untracked++;
+		return;
+	}
+	if (b->executions == 0) {
+		s.statics[kind]++;
+		s.new_branches[now - 1]++;
+	}
+	if (b->interval != now) {
+		b->interval = now;
+		s.live_branches[now - 1]++;
+	}
+	b->executions++;
+	b->taken += t.taken;
+
+	// a loop is a conditional branch that jumps backward; each time it
+	// falls through, the run of taken before it was one trip
+
+	if (kind != CLASS_CONDITIONAL) return;
+	if (t.taken && t.target < t.bi.address) b->backward = true;
+	if (!b->backward) return;
+	if (t.taken) {
+		b->run++;
+	} else {
+		s.trips[log_bucket (b->run + 1)]++;
+		b->run = 0;
+	}
+}
+
+static void summarize (trace_stats &s, const branch_table &table) {
+	vector<uint64_t> hot;
+	uint64_t tracked = 0;
+	for (size_t i = 0; i < table.entries.size (); i++) {
+		const branch_stats &b = table.entries[i];
+		if (!b.executions) continue;
+		hot.push_back (b.executions);
+		tracked += b.executions;
+		if (b.kind != CLASS_CONDITIONAL) continue;
+		double p = (double) b.taken / b.executions;
+		int bucket = min ((int) (p * RATE_BUCKETS), RATE_BUCKETS - 1);
+		s.rate_static[bucket]++;
+		s.rate_dynamic[bucket] += b.executions;
+		s.conditional_static++;
+		s.conditional_dynamic += b.executions;
+		s.entropy_static += entropy (p);
+		s.entropy_dynamic += entropy (p) * b.executions;
+	}
+	sort (hot.begin (), hot.end (), greater<uint64_t> ());
+	static const double coverage[3] = { 0.5, 0.9, 0.99 };
+	size_t j = 0;
+	uint64_t covered = 0;
+	for (int c = 0; c < 3; c++) {
+		while (j < hot.size () && covered < coverage[c] * tracked) covered += hot[j++];
+		s.cover[c] = j;
+	}
+}
+
+static void characterize (trace_stats &s) {
+	vector<trace> batch (BATCH_SIZE);
+	branch_table table (table_log);
+	trace_reader r;
+	if (!r.open (s.name.c_str ())) return;
+	uint64_t depth = 0;
+	for (;;) {
+		size_t k = r.read (&batch[0], BATCH_SIZE);
+		if (k == 0) break;
+		for (size_t i = 0; i < k; i++) {
+			if (s.branches % interval == 0) {
+				s.new_branches.push_back (0);
+				s.live_branches.push_back (0);
+			}
+			count (s, table, batch[i], depth);
+		}
+	}
+	r.close ();
+	summarize (s, table);
+	s.ok = true;
+}
+
+static void worker (void) {
+	for (;;) {
+		size_t i = next_trace++;
+		if (i >= results.size ()) return;
+		characterize (*results[i]);
+	}
+}
+
+static double percent (uint64_t part, uint64_t whole) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void print_log_histogram (const char *title, const uint64_t *h) {
+	uint64_t total = 0;
+	int last = 0;
+	for (int b = 0; b < LOG_BUCKETS; b++) {
+		total += h[b];
+		if (h[b]) last = b;
+	}
+	printf ("  %s:\n", title);
+	for (int b = 0; b <= last; b++) {
+		uint64_t lo = (uint64_t) 1 << b, hi = ((uint64_t) 2 << b) - 1;
+		if (b == LOG_BUCKETS - 1) printf ("    %6llu+       ", (unsigned long long) lo);
+		else printf ("    %6llu..%-6llu", (unsigned long long) lo, (unsigned long long) hi);
+		printf (" %12llu %6.2f%%\n", (unsigned long long) h[b], percent (h[b], total));
+	}
+}
+
+static void report (const trace_stats &s) {
+	printf ("%s\n", s.name.c_str ());
+	if (!s.ok) {
+		printf ("  could not be read\n\n");
+		return;
+	}
+	uint64_t statics = 0;
+	for (int k = 0; k < N_CLASSES; k++) statics += s.statics[k];
+	printf ("  %llu branches, %llu static", (unsigned long long) s.branches, (unsigned long long) statics);
+	if (s.untracked) printf (" and more: %llu executions of untracked branches", (unsigned long long) s.untracked);
+	printf ("\n");
+
+	printf ("  class              dynamic          static\n");
+	for (int k = 0; k < N_CLASSES; k++) {
+		printf ("    %-14s %12llu %6.2f%% %7llu\n", class_names[k], (unsigned long long) s.dynamic[k],
+			percent (s.dynamic[k], s.branches), (unsigned long long) s.statics[k]);
+	}
+
+	printf ("  footprint: %zu branches cover 50%%, %zu cover 90%%, %zu cover 99%%\n",
+		s.cover[0], s.cover[1], s.cover[2]);
+
+	printf ("  conditional taken rate      static        dynamic\n");
+	for (int b = 0; b < RATE_BUCKETS; b++) {
+		char range[32];
+		snprintf (range, sizeof range, "[%d%%..%d%%%s", 100 * b / RATE_BUCKETS, 100 * (b + 1) / RATE_BUCKETS,
+			b == RATE_BUCKETS - 1 ? "]" : ")");
+		printf ("    %-11s        %6.2f%%        %6.2f%%\n", range,
+			percent (s.rate_static[b], s.conditional_static), percent (s.rate_dynamic[b], s.conditional_dynamic));
+	}
+	printf ("  bias entropy: %.3f bits per static branch, %.3f per execution\n",
+		s.conditional_static ? s.entropy_static / s.conditional_static : 0.0,
+		s.conditional_dynamic ? s.entropy_dynamic / s.conditional_dynamic : 0.0);
+
+	print_log_histogram ("loop trip counts", s.trips);
+	printf ("  call depth: mean %.2f, max %llu\n", s.branches ? (double) s.depth_sum / s.branches : 0.0,
+		(unsigned long long) s.max_depth);
+	print_log_histogram ("call depth + 1, per branch", s.depths);
+
+	printf ("  working set per %llu branches:      new      live   total\n", (unsigned long long) interval);
+	uint64_t total = 0;
+	for (size_t i = 0; i < s.new_branches.size (); i++) {
+		total += s.new_branches[i];
+		printf ("    %-34llu %8llu %9llu %7llu\n", (unsigned long long) i * interval,
+			(unsigned long long) s.new_branches[i], (unsigned long long) s.live_branches[i],
+			(unsigned long long) total);
+	}
+	printf ("\n");
+}
+
+// add fname, or every trace file under it if it is a directory
+
+static void add_traces (const string &fname, vector<string> &names) {
+	struct stat st;
+	if (stat (fname.c_str (), &st) != 0 || !S_ISDIR (st.st_mode)) {
+		names.push_back (fname);
+		return;
+	}
+	DIR *d = opendir (fname.c_str ());
+	if (!d) {
+		perror (fname.c_str ());
+		return;
+	}
+	vector<string> found;
+	while (struct dirent *e = readdir (d)) {
+		if (e->d_name[0] == '.') continue;
+		string path = fname + "/" + e->d_name;
+		if (stat (path.c_str (), &st) != 0) continue;
+		if (S_ISDIR (st.st_mode) || strstr (e->d_name, ".trace")) found.push_back (path);
+	}
+	closedir (d);
+	sort (found.begin (), found.end ());
+	for (size_t i = 0; i < found.size (); i++) add_traces (found[i], names);
+}
+
+static void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [-j threads] [-s size] [-i interval] trace|directory...\n", prog);
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	int nthreads = thread::hardware_concurrency ();
+	int c;
+
+	while ((c = getopt (argc, argv, "j:s:i:")) != -1) {
+		switch (c) {
+		case 'j': nthreads = atoi (optarg); break;
+		case 's':
+			table_log = atoi (optarg);
+			if (table_log < 4 || table_log > 28) usage (argv[0]);
+			break;
+		case 'i':
+			interval = atoll (optarg);
+			if (interval == 0) usage (argv[0]);
+			break;
+		default: usage (argv[0]);
+		}
+	}
+	if (optind == argc) usage (argv[0]);
+	if (nthreads < 1) nthreads = 1;
+
+	vector<string> names;
+	for (int i = optind; i < argc; i++) add_traces (argv[i], names);
+	if (names.empty ()) {
+		fprintf (stderr, "%s: no traces\n", argv[0]);
+		exit (1);
+	}
+
+	for (size_t i = 0; i < names.size (); i++) results.push_back (new trace_stats (names[i]));
+	vector<thread> workers;
+	for (int i = 0; i < nthreads && i < (int) names.size (); i++) workers.push_back (thread (worker));
+	for (size_t i = 0; i < workers.size (); i++) workers[i].join ();
+
+	bool ok = true;
+	for (size_t i = 0; i < results.size (); i++) {
+		report (*results[i]);
+		ok = ok && results[i]->ok;
+		delete results[i];
+	}
+	exit (ok ? 0 : 1);
+}
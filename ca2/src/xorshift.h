@@ -0,0 +1,67 @@
+// xorshift.h
+// This file declares the pseudo-random generator the predictors use to pick
+// among allocation candidates: a 32-bit xorshift, about as cheap as the
+// LFSR a hardware predictor would use.  Each predictor owns its generators
+// instead of sharing libc's, so predictors running in different threads
+// never touch common state and a run depends only on its seed.
+//
+// One seed drives every generator in a predictor; each structure asks for
+// its own stream of it so that they do not step in lockstep.
+
+#ifndef XORSHIFT_H
+#define XORSHIFT_H
+
+#include <stdint.h>
+
+// the seed predict and sweep use unless told otherwise
+
+static const uint32_t DEFAULT_SEED = 1;
+
+class xorshift {
+public:
+	explicit xorshift(uint32_t seed = DEFAULT_SEED, uint32_t stream = 0) : state(mix(seed, stream)) {
+	}
+
+	uint32_t next(void) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// the number of heads before the first tail in a run of fair coin
+	// flips, from one draw
+
+	int geometric(void) {
+		return __builtin_ctz(~next() | 0x80000000u);
+	}
+
+	template <class IO>
+	void serialize(IO &io) {
+		io.pod(state);
+	}
+
+private:
+	uint32_t state;
+
+	// spread nearby seeds and streams over the state space; xorshift's
+	// state may not be 0
+
+	static uint32_t mix(uint32_t seed, uint32_t stream) {
+		uint64_t z = ((uint64_t) stream << 32 | seed) + 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		uint32_t s = (uint32_t) ((z ^ (z >> 31)) >> 32);
+		return s ? s : 0x2545f491;
+	}
+};
+
+// the streams of the structures that draw random numbers
+
+enum {
+	STREAM_TAGE,
+	STREAM_ITTAGE,
+	STREAM_LOOP
+};
+
+#endif // XORSHIFT_H
@@ -0,0 +1,20 @@
+# calls.wl
+# Nested calls and indirect jumps, for the return address stack and the
+# target predictor.
+
+seed 1
+branches 1000000
+
+call 4
+	indirect 6 cycle
+	random 0.7
+	call 12
+		indirect 3
+		pattern TNTTN
+	end
+end
+loop 5
+	call 2
+		random 0.95
+	end
+end
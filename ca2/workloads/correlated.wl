@@ -0,0 +1,19 @@
+# correlated.wl
+# Branches that repeat the outcome of a branch some distance back, for
+# the tagged tables.  Nothing is predictable from a branch's own bias.
+
+seed 1
+branches 1000000
+
+random 0.5
+random 0.5
+random 0.5
+correlated 2
+correlated 5
+correlated 12 0.02
+loop 20
+	random 0.5
+	correlated 1
+end
+correlated 40
+correlated 150
@@ -0,0 +1,18 @@
+# long.wl
+# A mix of everything, long enough to time predict on.
+
+seed 1
+branches 50000000
+
+loop 100 10
+	random 0.8
+	correlated 3 0.05
+	pattern TTTN
+	call 3
+		indirect 4
+		loop 8
+			correlated 1
+		end
+	end
+end
+random 0.5
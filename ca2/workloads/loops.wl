@@ -0,0 +1,16 @@
+# loops.wl
+# Nested loops of fixed and jittered trip counts, for the loop predictor
+# and for long global histories.
+
+seed 1
+branches 1000000
+
+loop 7
+	pattern TTN
+	loop 34
+		random 0.9
+	end
+	loop 12 3
+		correlated 1
+	end
+end
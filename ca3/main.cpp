@@ -1,6 +1,13 @@
+#include <stdint.h>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <unistd.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 enum Coherency {
@@ -12,113 +19,176 @@ enum Coherency {
     Forward,
 };
 
-struct Line {
+struct Line {  // a line's state; its tag is kept apart, in Cache::tags
     Line() {
         c = Invalid;
         lru = 0;
-        tag = 0;
         dirty = false;
     }
 
     Coherency c;
     int lru;
-    int tag;
     bool dirty;
 };
 
+// the shape of every core's cache. an address is split into
+// | tag | set index | line offset |; sets, ways and lineSize are powers of two
+
+struct Geometry {
+    Geometry() {
+        cores = 4;
+        sets = 1;
+        ways = 4;
+        lineSize = 1;
+    }
+
+    int cores;
+    int sets;
+    int ways;
+    int lineSize;
+};
+
+// a line is looked up once per access with find(), which compares the tag
+// against every way of the set at once, and the returned line number is the
+// handle for reading and changing its state. the tags are a separate dense
+// array, set by set, so a set's tags are contiguous for the comparison; an
+// invalid line's tag is NO_TAG, so only valid lines are ever found
+
 struct Cache {
-    Line lines[4];
+    static const uint64_t NO_TAG = ~(uint64_t)0;
+
+    vector<Line> lines;  // sets * ways, set by set
+    vector<uint64_t> tags;
+    int ways;
+    int setBits;
+    int offsetBits;
+
+    Cache(const Geometry &g) : lines(g.sets * g.ways), tags(g.sets * g.ways, NO_TAG) {
+        ways = g.ways;
+        setBits = log2(g.sets);
+        offsetBits = log2(g.lineSize);
+        for (int s = 0; s < g.sets; s++) {
+            for (int i = 0; i < ways; i++) {
+                lines[s * ways + i].lru = i;
+            }
+        }
+    }
+
+    static int log2(int n) {
+        int bits = 0;
+        while (n > 1) {
+            n >>= 1;
+            bits++;
+        }
+        return bits;
+    }
+
+    int setOf(const unsigned long address) const {  // the first line of the address's set
+        return ((address >> offsetBits) & ((1ul << setBits) - 1)) * ways;
+    }
 
-    Cache() {
-        for (int i = 0; i < 4; i++) {
-            lines[i].lru = i;
+    uint64_t tagOf(const unsigned long address) const {
+        return address >> offsetBits >> setBits;
+    }
+
+    int find(const unsigned long address) const {  // the line holding address, or -1
+        const int set = setOf(address);
+        const uint64_t tag = tagOf(address);
+        const uint64_t *t = &tags[set];
+#ifdef __SSE2__
+        if (ways >= 4) {  // four ways per step, two to a compare
+            const __m128i key = _mm_set1_epi64x(tag);
+            for (int i = 0; i < ways; i += 4) {
+                __m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(t + i)), key);
+                __m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(t + i + 2)), key);
+
+                // a way matches where both of its 32-bit halves do
+                lo = _mm_and_si128(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+                hi = _mm_and_si128(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+                const int mask = _mm_movemask_pd(_mm_castsi128_pd(lo)) | _mm_movemask_pd(_mm_castsi128_pd(hi)) << 2;
+                if (mask) return set + i + __builtin_ctz(mask);
+            }
+            return -1;
         }
+#endif
+        for (int i = 0; i < ways; i++) {
+            if (t[i] == tag) return set + i;
+        }
+        return -1;
     }
 
-    void updateLRU(const int old) {  // change entry with given old LRU state to be most recent
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].lru > old)
-                lines[i].lru--;
-            else if (lines[i].lru == old)
-                lines[i].lru = 3;
+    void updateLRU(const int line) {  // make the given line the most recent of its set
+        Line *set = &lines[line - line % ways];
+        const int old = lines[line].lru;
+        for (int i = 0; i < ways; i++) {
+            if (set[i].lru > old)
+                set[i].lru--;
+            else if (set[i].lru == old)
+                set[i].lru = ways - 1;
         }
     }
 
-    bool install(const int tag, const Coherency c,
+    bool install(const unsigned long address, const Coherency c,
                  const bool dirty) {  // returns whether writeback occurred
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].c == Invalid) {
-                return installIndex(tag, c, dirty, i);
+        const int set = setOf(address);
+        for (int i = 0; i < ways; i++) {
+            if (lines[set + i].c == Invalid) {
+                return installIndex(address, c, dirty, set + i);
             }
         }
 
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].lru == 0) {
-                return installIndex(tag, c, dirty, i);
+        for (int i = 0; i < ways; i++) {
+            if (lines[set + i].lru == 0) {
+                return installIndex(address, c, dirty, set + i);
             }
         }
 
         return false;
     }
 
-    bool installIndex(const int tag, const Coherency c, const bool dirty, const int index) {
-        const bool out = lines[index].dirty;
+    bool installIndex(const unsigned long address, const Coherency c, const bool dirty, const int line) {
+        const bool out = lines[line].dirty;
 
-        lines[index].tag = tag;
-        setCoherency(tag, c);
-        setDirty(tag, dirty);
-        updateLRU(lines[index].lru);
+        tags[line] = tagOf(address);
+        setCoherency(line, c);
+        setDirty(line, dirty);
+        updateLRU(line);
         return out;
     }
 
-    void access(const int tag) {  // helper function to update LRU for given tag
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].tag == tag) updateLRU(lines[i].lru);
-        }
+    void access(const int line) {  // helper function to update LRU for given line
+        updateLRU(line);
     }
 
-    Coherency getCoherency(const int tag) const {
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].tag == tag) return lines[i].c;
-        }
-        return Invalid;
+    Coherency getCoherency(const int line) const {
+        return line < 0 ? Invalid : lines[line].c;
     }
 
-    void setCoherency(const int tag, const Coherency c) {
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].tag == tag) {
-                lines[i].c = c;
-                break;
-            }
-        }
+    void setCoherency(const int line, const Coherency c) {
+        lines[line].c = c;
+        if (c == Invalid) tags[line] = NO_TAG;
     }
 
-    void setDirty(const int tag, const bool dirty) {
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].tag == tag) {
-                lines[i].dirty = dirty;
-                return;
-            }
-        }
+    void setDirty(const int line, const bool dirty) {
+        lines[line].dirty = dirty;
     }
 
-    bool getDirty(const int tag) const {
-        for (int i = 0; i < 4; i++) {
-            if (lines[i].tag == tag) return lines[i].dirty;
-        }
-        return false;
+    bool getDirty(const int line) const {
+        return line >= 0 && lines[line].dirty;
     }
 };
 
+const uint64_t Cache::NO_TAG;
+
 struct CPU {
-    Cache cores[4];
+    vector<Cache> cores;
     int hit;
     int miss;
     int writeback;
     int broadcast;
     int transfer;
 
-    CPU() {
+    CPU(const Geometry &g) : cores(g.cores, Cache(g)) {
         hit = 0;
         miss = 0;
         writeback = 0;
@@ -126,15 +196,16 @@ struct CPU {
         transfer = 0;
     }
 
-    void handle(const int core, const bool isRead, const int tag) {
-        isRead ? handleRead(core, tag) : handleWrite(core, tag);
+    void handle(const int core, const bool isRead, const unsigned long address) {
+        isRead ? handleRead(core, address) : handleWrite(core, address);
     }
 
-    void handleRead(const int core, const int tag) {
+    void handleRead(const int core, const unsigned long address) {
         bool transferred = false;
         bool isDirty = false;
 
-        switch (cores[core].getCoherency(tag)) {
+        const int line = cores[core].find(address);
+        switch (cores[core].getCoherency(line)) {
             case Modified:
             case Owned:
             case Forward:
@@ -142,23 +213,24 @@ struct CPU {
                 broadcast++;
             case Exclusive:
                 hit++;
-                cores[core].access(tag);
+                cores[core].access(line);
                 break;
             case Invalid:
                 miss++;
 
                 broadcast++;
-                for (int i = 0; i < 4; i++) {
+                for (int i = 0; i < (int)cores.size(); i++) {
                     if (i == core) continue;
 
-                    switch (cores[i].getCoherency(tag)) {
+                    const int other = cores[i].find(address);
+                    switch (cores[i].getCoherency(other)) {
                         case Modified:
-                            cores[i].setCoherency(tag, Owned);
+                            cores[i].setCoherency(other, Owned);
                             transferred = true;
                             isDirty = true;
                             break;
                         case Exclusive:
-                            cores[i].setCoherency(tag, Forward);
+                            cores[i].setCoherency(other, Forward);
                             transferred = true;
                             break;
                         case Forward:
@@ -173,86 +245,90 @@ struct CPU {
                 }
                 transfer += transferred;
 
-                writeback += cores[core].install(tag, transferred ? Shared : Exclusive, isDirty);
+                writeback += cores[core].install(address, transferred ? Shared : Exclusive, isDirty);
                 break;
             default:;
         }
     }
 
-    void handleWrite(const int core, const int tag) {
+    void handleWrite(const int core, const unsigned long address) {
         bool needWriteback = false;
 
-        switch (cores[core].getCoherency(tag)) {
+        const int line = cores[core].find(address);
+        switch (cores[core].getCoherency(line)) {
             case Modified:
                 hit++;
-                cores[core].access(tag);
+                cores[core].access(line);
                 break;
             case Owned:
                 hit++;
                 needWriteback = true;
 
                 broadcast++;
-                for (int i = 0; i < 4; i++) {
+                for (int i = 0; i < (int)cores.size(); i++) {
                     if (i == core) continue;
 
-                    switch (cores[i].getCoherency(tag)) {
+                    const int other = cores[i].find(address);
+                    switch (cores[i].getCoherency(other)) {
                         case Shared:
-                            cores[i].setCoherency(tag, Invalid);
+                            cores[i].setCoherency(other, Invalid);
                             break;
                         default:;
                     }
                 }
-                cores[core].setCoherency(tag, Modified);
-                cores[core].access(tag);
-                cores[core].setDirty(tag, true);
+                cores[core].setCoherency(line, Modified);
+                cores[core].access(line);
+                cores[core].setDirty(line, true);
             case Exclusive:
                 hit++;
-                cores[core].setCoherency(tag, Modified);
-                cores[core].access(tag);
-                cores[core].setDirty(tag, true);
+                cores[core].setCoherency(line, Modified);
+                cores[core].access(line);
+                cores[core].setDirty(line, true);
                 break;
             case Shared:
                 hit++;
 
                 broadcast++;
-                for (int i = 0; i < 4; i++) {
+                for (int i = 0; i < (int)cores.size(); i++) {
                     if (i == core) continue;
 
-                    switch (cores[i].getCoherency(tag)) {
+                    const int other = cores[i].find(address);
+                    switch (cores[i].getCoherency(other)) {
                         case Owned:
                             needWriteback = true;
                         case Forward:
                         case Shared:
-                            cores[i].setCoherency(tag, Invalid);
+                            cores[i].setCoherency(other, Invalid);
                             break;
                         default:;
                     }
                 }
 
-                cores[core].setCoherency(tag, Modified);
-                cores[core].access(tag);
-                cores[core].setDirty(tag, true);
+                cores[core].setCoherency(line, Modified);
+                cores[core].access(line);
+                cores[core].setDirty(line, true);
                 break;
             case Invalid:
                 miss++;
 
                 broadcast++;
-                for (int i = 0; i < 4; i++) {
+                for (int i = 0; i < (int)cores.size(); i++) {
                     if (i == core) continue;
 
-                    switch (cores[i].getCoherency(tag)) {
+                    const int other = cores[i].find(address);
+                    switch (cores[i].getCoherency(other)) {
                         case Owned:
                             needWriteback = true;
                         case Modified:
                         case Forward:
                         case Shared:
-                            cores[i].setCoherency(tag, Invalid);
+                            cores[i].setCoherency(other, Invalid);
                             break;
                         default:;
                     }
                 }
 
-                writeback += cores[core].install(tag, Modified, true);
+                writeback += cores[core].install(address, Modified, true);
                 break;
             default:;
         }
@@ -268,23 +344,73 @@ struct CPU {
     }
 };
 
+static void usage(const char *name) {
+    cerr << "usage: " << name << " [-c cores] [-s sets] [-w ways] [-l line_size] trace" << endl
+         << "\tdefaults: 4 cores, each with 1 set of 4 ways of 1-address lines" << endl;
+    exit(1);
+}
+
+static bool powerOfTwo(const int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
 int main(const int argc, char *argv[]) {
-    if (argc != 2) {
+    Geometry g;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:w:l:")) != -1) {
+        switch (opt) {
+            case 'c':
+                g.cores = atoi(optarg);
+                break;
+            case 's':
+                g.sets = atoi(optarg);
+                break;
+            case 'w':
+                g.ways = atoi(optarg);
+                break;
+            case 'l':
+                g.lineSize = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+    if (g.cores < 1 || !powerOfTwo(g.sets) || !powerOfTwo(g.ways) || !powerOfTwo(g.lineSize)) {
+        cerr << argv[0] << ": cores must be positive and sets, ways and line size powers of two" << endl;
         return 1;
     }
 
-    CPU cpu;
+    CPU cpu(g);
 
-    ifstream actions(argv[1]);
+    // each line is "P<core>: read <address>" or "P<core>: write <address>",
+    // cores numbered from 1
+
+    ifstream actions(argv[optind]);
+    if (!actions) {
+        cerr << argv[0] << ": cannot open " << argv[optind] << endl;
+        return 1;
+    }
     string action;
     while (getline(actions, action)) {
-        const int core = stoi(action.substr(1, 1)) - 1;
-        const bool isRead = action[4] == 'r';
-
+        const size_t colon = action.find(':');
         const size_t tagStart = action.find('<') + 1;
-        const int tag = stoi(action.substr(tagStart, action.length() - 1 - tagStart));
+        if (action.empty() || action[0] != 'P' || colon == string::npos || tagStart == 0) continue;
+
+        const int core = atoi(action.substr(1, colon - 1).c_str()) - 1;
+        const bool isRead = action.find("read", colon) != string::npos;
+        // decimal, or hexadecimal with a 0x prefix; a leading 0 is not octal
+        const char *tag = action.c_str() + tagStart;
+        const bool hex = tag[0] == '0' && (tag[1] == 'x' || tag[1] == 'X');
+        const unsigned long address = hex ? strtoul(tag + 2, NULL, 16) : strtoul(tag, NULL, 10);
+        if (core < 0 || core >= g.cores) {
+            cerr << argv[0] << ": no core " << core + 1 << ": " << action << endl;
+            return 1;
+        }
 
-        cpu.handle(core, isRead, tag);
+        cpu.handle(core, isRead, address);
     }
 
     cpu.report();